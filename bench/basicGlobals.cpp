@@ -1,7 +1,4 @@
-#include <iostream>
-#include <sys/times.h>
-#include <thread>
-#include <time.h>
+#include "fs_bench.h"
 
 volatile int fsData1 = 0;
 volatile int fsData2 = 0;
@@ -11,48 +8,30 @@ alignas(64) volatile int data2 = 0;
 
 const int NUM_LOOPS = 1000000;
 const int NUM_RUNS = 40;
+const int MAX_THREADS = 64;
 
-double compute(struct timespec start, struct timespec end) {
-  double t;
-  t = (end.tv_sec - start.tv_sec) * 1000;
-  t += (end.tv_nsec - start.tv_nsec) * 0.000001;
-  return t;
-}
+long numLoops;
 
 void runThread(volatile int *threadData) {
-  for (int i = 0; i < NUM_LOOPS; ++i) {
+  for (long i = 0; i < numLoops; ++i) {
     ++(*threadData);
   }
 }
 
-int main() {
-  timespec tpBegin1, tpEnd1, tpBegin2, tpEnd2;
-  clock_gettime(CLOCK_REALTIME, &tpBegin1);
-  for (int i = 0; i < NUM_RUNS; i++) {
-    std::thread thread1{runThread, &fsData1};
-    std::thread thread2{runThread, &fsData2};
-    thread1.join();
-    thread2.join();
-  }
-  clock_gettime(CLOCK_REALTIME, &tpEnd1);
-
-  clock_gettime(CLOCK_REALTIME, &tpBegin2);
-  for (int i = 0; i < NUM_RUNS; i++) {
-    std::thread thread1{runThread, &data1};
-    std::thread thread2{runThread, &data2};
-    thread1.join();
-    thread2.join();
-  }
-  clock_gettime(CLOCK_REALTIME, &tpEnd2);
-
-  auto time1 = compute(tpBegin1, tpEnd1);
-  auto time2 = compute(tpBegin2, tpEnd2);
+int main(int argc, char **argv) {
+  fs_bench::Harness harness("basicGlobals", argc, argv, NUM_RUNS);
+  numLoops = harness.iterations(NUM_LOOPS);
+  // Threads beyond the first two alternate between the same two variables,
+  // adding true sharing on top of the false sharing.
+  const int numThreads = harness.threads(2, MAX_THREADS);
 
-  printf("Average time taken over %d runs with false sharing      : %f ms\n",
-         NUM_RUNS, time1 / NUM_RUNS);
+  volatile int *fsData[] = {&fsData1, &fsData2};
+  harness.run("with false sharing", numThreads,
+              [&](int thread) { runThread(fsData[thread % 2]); });
 
-  printf("Average time taken over %d runs without false sharing      : %f ms\n",
-         NUM_RUNS, time2 / NUM_RUNS);
+  volatile int *data[] = {&data1, &data2};
+  harness.run("without false sharing", numThreads,
+              [&](int thread) { runThread(data[thread % 2]); });
 
-  return 0;
+  return harness.report();
 }
@@ -1,12 +1,13 @@
-#include <iostream>
 #include <mutex>
-#include <thread>
-#include <vector>
+
+#include "fs_bench.h"
 
 const int NUM_RUNS = 10;
 const int NUM_THREADS = 40;
 const int NUM_LOOPS = 1000000;
 
+long numLoops;
+
 namespace {
 struct MyStruct {
     std::mutex m1;
@@ -17,21 +18,17 @@ MyStruct data{};
 
 void run_thread(int thread_id) {
     while (!data.m1.try_lock()) {}
-    for (int i = 0; i < NUM_LOOPS; ++i) {
+    for (long i = 0; i < numLoops; ++i) {
         ++data.m1Data[thread_id];
     }
     data.m1.unlock();
 }
 
-int main() {
-    for (int i = 0; i < NUM_RUNS; ++i) {
-        std::vector<std::thread> threads;
-        for (int i = 0; i < NUM_THREADS; ++i) {
-            threads.emplace_back(run_thread, i);
-        }
-        for (auto &thread : threads) {
-            thread.join();
-        }
-    }
-    return data.m1Data[0] == 123 ? 1 : 0;
+int main(int argc, char **argv) {
+    fs_bench::Harness harness("basicLocks", argc, argv, NUM_RUNS);
+    numLoops = harness.iterations(NUM_LOOPS);
+    harness.run("lock next to data", harness.threads(NUM_THREADS, NUM_THREADS),
+                run_thread);
+    int result = harness.report();
+    return data.m1Data[0] == 123 ? 1 : result;
 }
\ No newline at end of file
@@ -0,0 +1,26 @@
+#!/bin/bash
+# Checks the results a benchmark prints against an expected-result file.
+#
+# Usage: bench/check.sh <benchmark binary> <expected file>
+#
+# The expected file holds the output of the benchmark without the harness's
+# timing lines, which vary from run to run. Lines starting with # are comments,
+# except for "# args: ..." which gives the benchmark options to run with; these
+# should fix the number of trials, warmup trials and threads so the results are
+# deterministic. Used by `make check` and evaluate.sh, which checks that fixed
+# binaries compute the same results as the originals.
+set -Eeuo pipefail
+
+if [ $# -ne 2 ]; then
+    >&2 echo "Usage: bench/check.sh <benchmark binary> <expected file>"
+    exit 1
+fi
+
+read -r -a ARGS <<< "$(sed -n 's/^# args: //p' "${2}")"
+
+if ! diff -u <(grep -v '^#' "${2}") \
+        <("${1}" "${ARGS[@]}" | grep -v ' median .* ms  p95 '); then
+    >&2 echo "${1}: results differ from ${2}"
+    exit 1
+fi
+echo "${1}: results match ${2}"
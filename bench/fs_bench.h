@@ -0,0 +1,386 @@
+// Benchmark harness for the programs in bench/.
+//
+// Each case runs a body on a number of threads. The threads are created
+// before timing starts and wait at a start gate, so only the contended work is
+// timed: a trial starts when the gate opens and ends when the last thread
+// finishes its body. After some warmup trials, the harness times repeated
+// trials on a monotonic clock and reports the median, 95th percentile, mean
+// and 95% confidence interval of the mean of each case, on stdout and
+// optionally as JSON.
+//
+// With --counters, each thread also counts performance events while it runs
+// its body (see fs_perf.h); the per-trial totals over all threads are
+// reported next to the timings.
+//
+// Timed trials are the profiling region of interest (see fs_roi.h), so the
+// Pin tools skip thread creation, warmup and reporting.
+//
+// Command line options:
+//   --trials N         timed trials per case
+//   --warmup N         untimed trials per case before the timed ones
+//   --json PATH        also write the results to PATH as JSON
+//   --counters         count performance events during timed trials
+//   --hitm-event RAW   raw perf event config (hex) counting HITM snoops
+//   --threads N        number of threads of the parallel cases
+//   --stride N         distance between the data of consecutive threads, in
+//                      elements
+//   --iterations N     iterations of each thread's loop
+// A benchmark reads the last three with threads(), stride() and iterations(),
+// giving its defaults; options that a benchmark does not use are reported.
+//
+// The harness is header-only because the benchmarks are compiled as single
+// translation units by src/run.sh.
+
+#ifndef FS_BENCH_H
+#define FS_BENCH_H
+
+#include "fs_perf.h"
+#include "fs_roi.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs_bench {
+
+// Statistics of the timed trials of a case, in milliseconds
+struct Summary {
+  double median;
+  double p95;
+  double mean;
+  double ci95; // half-width of the 95% confidence interval of the mean
+  double min;
+  double max;
+};
+
+// Two-sided 95% critical values of Student's t distribution for 1 to 30
+// degrees of freedom; the normal value is used beyond that.
+inline double tCritical95(size_t degreesOfFreedom) {
+  static const double table[] = {
+      12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+      2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+      2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+  if (degreesOfFreedom == 0)
+    return 0;
+  if (degreesOfFreedom <= sizeof(table) / sizeof(table[0]))
+    return table[degreesOfFreedom - 1];
+  return 1.960;
+}
+
+inline Summary summarize(std::vector<double> samples) {
+  Summary summary{};
+  if (samples.empty())
+    return summary;
+  std::sort(samples.begin(), samples.end());
+  const size_t n = samples.size();
+  summary.min = samples.front();
+  summary.max = samples.back();
+  summary.median = n % 2 ? samples[n / 2]
+                         : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+  // nearest-rank percentile
+  summary.p95 = samples[static_cast<size_t>(std::ceil(0.95 * n)) - 1];
+
+  double sum = 0;
+  for (double sample : samples)
+    sum += sample;
+  summary.mean = sum / n;
+  if (n > 1) {
+    double squares = 0;
+    for (double sample : samples)
+      squares += (sample - summary.mean) * (sample - summary.mean);
+    const double stddev = std::sqrt(squares / (n - 1));
+    summary.ci95 = tCritical95(n - 1) * stddev / std::sqrt(n);
+  }
+  return summary;
+}
+
+// Small per-thread pseudo-random generator (xorshift64) for benchmarks whose
+// threads pick random keys or values, so that they do not contend on the state
+// of a shared generator.
+struct Random {
+  uint64_t state;
+
+  explicit Random(uint64_t seed) : state(seed * 0x9e3779b97f4a7c15ull + 1) {}
+
+  uint64_t next() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+};
+
+class Harness {
+public:
+  // defaultTrials suits the length of the benchmark's trials; --trials
+  // overrides it.
+  Harness(const char *benchmarkName, int argc, char **argv,
+          int defaultTrials = 10)
+      : name(benchmarkName), trials(defaultTrials) {
+    for (int i = 1; i < argc; i++) {
+      if (!std::strcmp(argv[i], "--trials") && i + 1 < argc) {
+        trials = std::atoi(argv[++i]);
+      } else if (!std::strcmp(argv[i], "--warmup") && i + 1 < argc) {
+        warmup = std::atoi(argv[++i]);
+      } else if (!std::strcmp(argv[i], "--json") && i + 1 < argc) {
+        jsonPath = argv[++i];
+      } else if (!std::strcmp(argv[i], "--counters")) {
+        useCounters = true;
+      } else if (!std::strcmp(argv[i], "--hitm-event") && i + 1 < argc) {
+        hitmConfig = std::strtoull(argv[++i], nullptr, 16);
+        useCounters = true;
+      } else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc) {
+        threadsOption = {std::atol(argv[++i]), true, false};
+      } else if (!std::strcmp(argv[i], "--stride") && i + 1 < argc) {
+        strideOption = {std::atol(argv[++i]), true, false};
+      } else if (!std::strcmp(argv[i], "--iterations") && i + 1 < argc) {
+        iterationsOption = {std::atol(argv[++i]), true, false};
+      } else {
+        std::fprintf(stderr,
+                     "Usage: %s [--trials N] [--warmup N] [--json PATH] "
+                     "[--counters] [--hitm-event RAW] [--threads N] "
+                     "[--stride N] [--iterations N]\n",
+                     argv[0]);
+        std::exit(1);
+      }
+    }
+    if (trials < 1)
+      trials = 1;
+    if (warmup < 0)
+      warmup = 0;
+    if (useCounters) {
+      events = chooseEvents(hitmConfig);
+      if (events.empty())
+        std::fprintf(stderr, "%s: performance counters are not available; "
+                             "check perf_event_paranoid\n",
+                     argv[0]);
+      else if (events[0].type == PERF_TYPE_SOFTWARE)
+        std::fprintf(stderr, "%s: hardware counters are not available; "
+                             "counting software events\n",
+                     argv[0]);
+    }
+  }
+
+  // Number of threads, between 1 and maxThreads
+  int threads(int defaultThreads, int maxThreads) {
+    return static_cast<int>(
+        threadsOption.get("--threads", defaultThreads, 1, maxThreads));
+  }
+
+  // Distance between the data of consecutive threads, between 1 and maxStride
+  int stride(int defaultStride, int maxStride) {
+    return static_cast<int>(
+        strideOption.get("--stride", defaultStride, 1, maxStride));
+  }
+
+  long iterations(long defaultIterations) {
+    return iterationsOption.get("--iterations", defaultIterations, 1,
+                                LONG_MAX);
+  }
+
+  // Runs body(threadIndex) on numThreads threads for every trial. setup, if
+  // given, runs before each trial's threads start and is not timed.
+  void run(const std::string &caseName, int numThreads,
+           const std::function<void(int)> &body,
+           const std::function<void()> &setup = nullptr) {
+    Case result{caseName, numThreads, {}, {}, {}};
+    for (int trial = 0; trial < warmup + trials; trial++) {
+      const bool timed = trial >= warmup;
+      std::vector<uint64_t> counts;
+      if (setup)
+        setup();
+      const double ms = runTrial(numThreads, body, timed, counts);
+      if (timed) {
+        result.samples.push_back(ms);
+        result.counts.push_back(std::move(counts));
+      }
+    }
+    result.summary = summarize(result.samples);
+
+    const Summary &s = result.summary;
+    std::printf("%-40s median %10.3f ms  p95 %10.3f ms  mean %10.3f +- %.3f "
+                "ms  (%zu trials, %d threads)\n",
+                caseName.c_str(), s.median, s.p95, s.mean, s.ci95,
+                result.samples.size(), numThreads);
+    if (!events.empty()) {
+      std::printf("%-40s", "");
+      for (size_t e = 0; e < events.size(); e++) {
+        std::vector<double> perTrial;
+        for (const auto &counts : result.counts)
+          perTrial.push_back(static_cast<double>(counts[e]));
+        std::printf(" %s %.0f", events[e].name.c_str(),
+                    summarize(perTrial).median);
+      }
+      std::printf("  (median per trial)\n");
+    }
+    cases.push_back(std::move(result));
+  }
+
+  // Writes the JSON report if requested. Returns the process exit code.
+  int report() const {
+    threadsOption.warnIfUnused("--threads", name);
+    strideOption.warnIfUnused("--stride", name);
+    iterationsOption.warnIfUnused("--iterations", name);
+    if (jsonPath.empty())
+      return 0;
+    FILE *out = std::fopen(jsonPath.c_str(), "w");
+    if (!out) {
+      std::perror(jsonPath.c_str());
+      return 1;
+    }
+    std::fprintf(out, "{\"benchmark\": \"%s\", \"warmup\": %d", name.c_str(),
+                 warmup);
+    if (strideOption.used)
+      std::fprintf(out, ", \"stride\": %ld", strideOption.value);
+    if (iterationsOption.used)
+      std::fprintf(out, ", \"iterations\": %ld", iterationsOption.value);
+    std::fprintf(out, ", \"cases\": [");
+    for (size_t i = 0; i < cases.size(); i++) {
+      const Case &c = cases[i];
+      const Summary &s = c.summary;
+      std::fprintf(out,
+                   "%s\n  {\"name\": \"%s\", \"threads\": %d, \"trials\": %zu, "
+                   "\"median_ms\": %.6f, \"p95_ms\": %.6f, \"mean_ms\": %.6f, "
+                   "\"ci95_ms\": %.6f, \"min_ms\": %.6f, \"max_ms\": %.6f, "
+                   "\"samples_ms\": [",
+                   i ? "," : "", c.name.c_str(), c.threads, c.samples.size(),
+                   s.median, s.p95, s.mean, s.ci95, s.min, s.max);
+      for (size_t j = 0; j < c.samples.size(); j++)
+        std::fprintf(out, "%s%.6f", j ? ", " : "", c.samples[j]);
+      std::fprintf(out, "]");
+      if (!events.empty()) {
+        // counter totals over all threads, one per timed trial
+        std::fprintf(out, ", \"counters\": {");
+        for (size_t e = 0; e < events.size(); e++) {
+          std::fprintf(out, "%s\"%s\": [", e ? ", " : "",
+                       events[e].name.c_str());
+          for (size_t j = 0; j < c.counts.size(); j++)
+            std::fprintf(out, "%s%llu", j ? ", " : "",
+                         static_cast<unsigned long long>(c.counts[j][e]));
+          std::fprintf(out, "]");
+        }
+        std::fprintf(out, "}");
+      }
+      std::fprintf(out, "}");
+    }
+    std::fprintf(out, "\n]}\n");
+    std::fclose(out);
+    return 0;
+  }
+
+private:
+  struct Case {
+    std::string name;
+    int threads;
+    std::vector<double> samples;
+    Summary summary;
+    std::vector<std::vector<uint64_t>> counts; // per trial, per event
+  };
+
+  // A numeric option that the benchmark may read with its own default
+  struct Option {
+    long value = 0;
+    bool given = false;
+    bool used = false;
+
+    long get(const char *flag, long defaultValue, long min, long max) {
+      if (!given)
+        value = defaultValue;
+      if (value < min || value > max) {
+        std::fprintf(stderr, "%s must be between %ld and %ld\n", flag, min,
+                     max);
+        std::exit(1);
+      }
+      used = true;
+      return value;
+    }
+
+    void warnIfUnused(const char *flag, const std::string &benchmark) const {
+      if (given && !used)
+        std::fprintf(stderr, "%s: %s is not used by this benchmark\n",
+                     benchmark.c_str(), flag);
+    }
+  };
+
+  // Each counter is on its own cache line so the harness does not add false
+  // sharing of its own.
+  struct Gate {
+    alignas(64) std::atomic<int> ready{0};
+    alignas(64) std::atomic<bool> open{false};
+    alignas(64) std::atomic<int> running{0};
+  };
+
+  std::string name;
+  int trials;
+  int warmup = 1;
+  std::string jsonPath;
+  bool useCounters = false;
+  uint64_t hitmConfig = 0;
+  std::vector<CounterEvent> events;
+  Option threadsOption;
+  Option strideOption;
+  Option iterationsOption;
+  std::vector<Case> cases;
+
+  // Returns the duration of the trial in milliseconds, and in counts the
+  // totals of events over all threads if the trial is timed.
+  double runTrial(int numThreads, const std::function<void(int)> &body,
+                  bool timed, std::vector<uint64_t> &counts) {
+    Gate gate;
+    gate.running.store(numThreads);
+    const bool count = timed && !events.empty();
+    std::vector<std::vector<uint64_t>> threadCounts(numThreads);
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads);
+    for (int i = 0; i < numThreads; i++) {
+      threads.emplace_back([this, &gate, &body, &threadCounts, count, i] {
+        // opened before the gate so that only the body is counted
+        ThreadCounters counters(count ? events : std::vector<CounterEvent>());
+        gate.ready.fetch_add(1);
+        while (!gate.open.load(std::memory_order_acquire))
+          std::this_thread::yield();
+        counters.start();
+        body(i);
+        counters.stop();
+        threadCounts[i] = counters.read();
+        gate.running.fetch_sub(1, std::memory_order_release);
+      });
+    }
+    while (gate.ready.load() < numThreads)
+      std::this_thread::yield();
+
+    if (timed)
+      fs_roi_begin();
+    const auto start = std::chrono::steady_clock::now();
+    gate.open.store(true, std::memory_order_release);
+    while (gate.running.load(std::memory_order_acquire) > 0)
+      std::this_thread::yield();
+    const auto end = std::chrono::steady_clock::now();
+    if (timed)
+      fs_roi_end();
+
+    for (auto &thread : threads)
+      thread.join();
+    if (count) {
+      counts.assign(events.size(), 0);
+      for (const auto &values : threadCounts)
+        for (size_t e = 0; e < values.size(); e++)
+          counts[e] += values[e];
+    }
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  }
+};
+
+} // namespace fs_bench
+
+#endif // FS_BENCH_H
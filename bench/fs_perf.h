@@ -0,0 +1,148 @@
+// Performance counters for the benchmark harness (see fs_bench.h).
+//
+// Counts events with perf_event_open(2) on each benchmark thread while it runs
+// its body. Hardware events show whether the coherence traffic of false
+// sharing goes away: cycles, instructions, L1D read misses and, if given
+// with --hitm-event, a raw model-specific event counting loads that hit a
+// modified line in another core's cache (e.g. 0x04d2,
+// MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM, on Skylake). In VMs and containers
+// hardware events are often unavailable; software events (task clock, context
+// switches, migrations, page faults) are counted instead. Events that cannot be
+// opened are left out.
+
+#ifndef FS_PERF_H
+#define FS_PERF_H
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace fs_bench {
+
+struct CounterEvent {
+  std::string name;
+  uint32_t type;
+  uint64_t config;
+};
+
+inline int openCounter(const CounterEvent &event) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = event.type;
+  attr.config = event.config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  // this thread only, on any CPU
+  return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+inline std::vector<CounterEvent> hardwareEvents(uint64_t hitmConfig) {
+  std::vector<CounterEvent> events = {
+      {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {"l1d-read-misses", PERF_TYPE_HW_CACHE,
+       PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)}};
+  if (hitmConfig)
+    events.push_back({"hitm", PERF_TYPE_RAW, hitmConfig});
+  return events;
+}
+
+inline std::vector<CounterEvent> softwareEvents() {
+  return {{"task-clock-ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+          {"context-switches", PERF_TYPE_SOFTWARE,
+           PERF_COUNT_SW_CONTEXT_SWITCHES},
+          {"cpu-migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+          {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS}};
+}
+
+// Returns the events of candidates that can be opened by this process
+inline std::vector<CounterEvent>
+availableEvents(const std::vector<CounterEvent> &candidates) {
+  std::vector<CounterEvent> available;
+  for (const CounterEvent &event : candidates) {
+    int fd = openCounter(event);
+    if (fd >= 0) {
+      close(fd);
+      available.push_back(event);
+    }
+  }
+  return available;
+}
+
+// Chooses the events to count: the hardware events that are available, or
+// the software ones if no hardware event is. Empty if perf_event_open is not
+// permitted at all.
+inline std::vector<CounterEvent> chooseEvents(uint64_t hitmConfig) {
+  std::vector<CounterEvent> events = availableEvents(hardwareEvents(hitmConfig));
+  if (events.empty())
+    events = availableEvents(softwareEvents());
+  return events;
+}
+
+// Counters of the calling thread. Must be started, stopped and read on the
+// thread that created it.
+class ThreadCounters {
+public:
+  explicit ThreadCounters(const std::vector<CounterEvent> &events) {
+    for (const CounterEvent &event : events)
+      fds.push_back(openCounter(event));
+  }
+  ~ThreadCounters() {
+    for (int fd : fds)
+      if (fd >= 0)
+        close(fd);
+  }
+  ThreadCounters(const ThreadCounters &) = delete;
+  ThreadCounters &operator=(const ThreadCounters &) = delete;
+
+  void start() {
+    for (int fd : fds) {
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+  }
+
+  void stop() {
+    for (int fd : fds)
+      if (fd >= 0)
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  }
+
+  // Counts since start(), scaled up if the kernel multiplexed the events.
+  // Events that could not be opened on this thread read as 0.
+  std::vector<uint64_t> read() const {
+    std::vector<uint64_t> values;
+    for (int fd : fds) {
+      uint64_t data[3] = {0, 0, 0}; // value, time enabled, time running
+      if (fd < 0 || ::read(fd, data, sizeof(data)) != sizeof(data)) {
+        values.push_back(0);
+      } else if (data[2] && data[2] < data[1]) {
+        values.push_back(static_cast<uint64_t>(
+            static_cast<double>(data[0]) * data[1] / data[2]));
+      } else {
+        values.push_back(data[0]);
+      }
+    }
+    return values;
+  }
+
+private:
+  std::vector<int> fds;
+};
+
+} // namespace fs_bench
+
+#endif // FS_PERF_H
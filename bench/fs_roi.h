@@ -0,0 +1,28 @@
+// Region-of-interest markers for false sharing profiling.
+//
+// When a program defines these functions, pinatrace and mdcache only analyze
+// memory accesses made between a call to fs_roi_begin() and the following
+// call to fs_roi_end(), instead of the whole run including the dynamic
+// loader, static initializers and serial phases. The functions do nothing on
+// their own; they must not be inlined so the Pin tools can find them.
+
+#ifndef FS_ROI_H
+#define FS_ROI_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+__attribute__((noinline, weak, used)) void fs_roi_begin(void) {
+  __asm__ volatile("" ::: "memory");
+}
+
+__attribute__((noinline, weak, used)) void fs_roi_end(void) {
+  __asm__ volatile("" ::: "memory");
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FS_ROI_H
@@ -0,0 +1,21 @@
+# Shell helpers for scripts that run the benchmarks, sourced by sweep.sh and
+# evaluate.sh.
+
+# Compiles benchmark source $1 to $2 like src/run.sh does, without a pass, so
+# baseline and fixed binaries differ only in the pass
+build_baseline() {
+    local bitcode="${2}.bc"
+    clang -O3 -emit-llvm "${1}" -c -o "${bitcode}"
+    clang -O3 -pthread -lstdc++ "${bitcode}" -o "${2}"
+    rm -f "${bitcode}"
+}
+
+# Prints "threads case median ci95 iterations", tab separated, for each case of
+# a JSON report, relying on fs_bench.h writing one case per line. Iterations
+# are 0 if the benchmark does not read --iterations.
+harness_cases() {
+    local iterations
+    iterations=$(sed -n 's/.*"iterations": \([0-9]*\).*/\1/p' "${1}" | head -n 1)
+    sed -n 's/.*"name": "\([^"]*\)", "threads": \([0-9]*\),.*"median_ms": \([0-9.]*\),.*"ci95_ms": \([0-9.]*\),.*/\2\t\1\t\3\t\4/p' "${1}" |
+        awk -F '\t' -v iterations="${iterations:-0}" -v OFS='\t' '{ print $1, $2, $3, $4, iterations }'
+}
@@ -0,0 +1,60 @@
+// Per-thread objects allocated with new one after the other: the allocator
+// places small objects next to each other, so the counters of different threads
+// share cache lines although no global variable is involved.
+
+#include <cstdio>
+#include <vector>
+
+#include "fs_bench.h"
+
+namespace {
+struct Counter {
+  long value = 0;
+};
+
+struct alignas(64) PaddedCounter {
+  long value = 0;
+};
+} // namespace
+
+const int MAX_THREADS = 64;
+const int NUM_LOOPS = 1000000;
+const int NUM_RUNS = 10;
+
+long numLoops;
+
+template <typename T> void runThread(T *counter) {
+  volatile long &value = counter->value;
+  for (long i = 0; i < numLoops; ++i) {
+    value = value + 1;
+  }
+}
+
+template <typename T>
+void runCase(fs_bench::Harness &harness, const char *caseName,
+             int numThreads) {
+  std::vector<T *> counters;
+  for (int i = 0; i < numThreads; ++i) {
+    counters.push_back(new T);
+  }
+  harness.run(caseName, numThreads,
+              [&](int thread) { runThread(counters[thread]); });
+
+  long total = 0;
+  for (T *counter : counters) {
+    total += counter->value;
+    delete counter;
+  }
+  printf("%s: %ld updates\n", caseName, total);
+}
+
+int main(int argc, char **argv) {
+  fs_bench::Harness harness("heapObjects", argc, argv, NUM_RUNS);
+  numLoops = harness.iterations(NUM_LOOPS);
+  const int numThreads = harness.threads(2, MAX_THREADS);
+
+  runCase<Counter>(harness, "with false sharing", numThreads);
+  runCase<PaddedCounter>(harness, "without false sharing", numThreads);
+
+  return harness.report();
+}
@@ -0,0 +1,82 @@
+// Latency histogram service: each worker records the latency of the requests
+// it serves into its own statistics struct, which a reporter thread would read
+// with relaxed loads. The structs are smaller than a cache line and sit in one
+// array, so neighboring workers write to the same lines.
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+#include "fs_bench.h"
+
+namespace {
+const int NUM_BUCKETS = 8;
+
+struct ThreadStats {
+  std::atomic<uint32_t> count;
+  std::atomic<uint32_t> max;
+  std::atomic<uint64_t> sum;
+  std::atomic<uint32_t> buckets[NUM_BUCKETS];
+};
+
+struct alignas(64) PaddedThreadStats {
+  std::atomic<uint32_t> count;
+  std::atomic<uint32_t> max;
+  std::atomic<uint64_t> sum;
+  std::atomic<uint32_t> buckets[NUM_BUCKETS];
+};
+} // namespace
+
+const int MAX_THREADS = 64;
+const int NUM_LOOPS = 1000000;
+const int NUM_RUNS = 10;
+
+ThreadStats stats[MAX_THREADS];
+PaddedThreadStats paddedStats[MAX_THREADS];
+
+long numLoops;
+
+// Only the owning thread writes its stats, so relaxed load/store pairs suffice
+template <typename Stats> void record(Stats &s, uint32_t latency) {
+  s.count.store(s.count.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+  s.sum.store(s.sum.load(std::memory_order_relaxed) + latency,
+              std::memory_order_relaxed);
+  if (latency > s.max.load(std::memory_order_relaxed))
+    s.max.store(latency, std::memory_order_relaxed);
+  int bucket = 0;
+  while (bucket < NUM_BUCKETS - 1 && latency >> (bucket + 4))
+    bucket++;
+  auto &b = s.buckets[bucket];
+  b.store(b.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+template <typename Stats> void serveRequests(Stats &s, int thread) {
+  fs_bench::Random random(thread);
+  for (long i = 0; i < numLoops; ++i) {
+    record(s, static_cast<uint32_t>(random.next() % 4096));
+  }
+}
+
+template <typename Stats> uint64_t totalCount(const Stats *all) {
+  uint64_t total = 0;
+  for (int i = 0; i < MAX_THREADS; ++i)
+    total += all[i].count.load();
+  return total;
+}
+
+int main(int argc, char **argv) {
+  fs_bench::Harness harness("histogramStats", argc, argv, NUM_RUNS);
+  numLoops = harness.iterations(NUM_LOOPS);
+  const int numThreads = harness.threads(4, MAX_THREADS);
+
+  harness.run("with false sharing", numThreads,
+              [](int thread) { serveRequests(stats[thread], thread); });
+  harness.run("without false sharing", numThreads,
+              [](int thread) { serveRequests(paddedStats[thread], thread); });
+
+  printf("requests recorded: %llu, %llu\n",
+         static_cast<unsigned long long>(totalCount(stats)),
+         static_cast<unsigned long long>(totalCount(paddedStats)));
+  return harness.report();
+}
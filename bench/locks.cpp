@@ -1,11 +1,10 @@
+#include <cstdio>
 #include <condition_variable>
-#include <iostream>
 #include <mutex>
-#include <sys/times.h>
-#include <thread>
-#include <time.h>
 #include <vector>
 
+#include "fs_bench.h"
+
 std::mutex m1;
 std::mutex m2;
 std::condition_variable c1;
@@ -15,16 +14,12 @@ std::vector<int> v2;
 
 const int NUM_LOOPS = 10000;
 const int NUM_RUNS = 500;
+const int MAX_THREADS = 64;
 
-double compute(struct timespec start, struct timespec end) {
-  double t;
-  t = (end.tv_sec - start.tv_sec) * 1000;
-  t += (end.tv_nsec - start.tv_nsec) * 0.000001;
-  return t;
-}
+long numLoops;
 
 void producer(const int threadID) {
-  for (int i = 0; i < NUM_LOOPS; ++i) {
+  for (long i = 0; i < numLoops; ++i) {
     switch (threadID) {
     case 1:
       m1.lock();
@@ -46,7 +41,7 @@ void consumer(int threadID) {
   int val = 0;
   auto lk1 = std::unique_lock<std::mutex>(m1, std::defer_lock);
   auto lk2 = std::unique_lock<std::mutex>(m2, std::defer_lock);
-  for (int i = 0; i < NUM_LOOPS; ++i) {
+  for (long i = 0; i < numLoops; ++i) {
     switch (threadID) {
     case 1:
       lk1.lock();
@@ -70,27 +65,26 @@ void consumer(int threadID) {
   }
 }
 
-int main() {
-  timespec tpBegin1, tpEnd1;
-
-  clock_gettime(CLOCK_REALTIME, &tpBegin1);
-  for (int i = 0; i < NUM_RUNS; i++) {
-    std::thread thread1{producer, 1};
-    std::thread thread3{consumer, 1};
-
-    std::thread thread2{producer, 2};
-    std::thread thread4{consumer, 2};
-    thread1.join();
-    thread2.join();
-    thread3.join();
-    thread4.join();
+int main(int argc, char **argv) {
+  fs_bench::Harness harness("locks", argc, argv, NUM_RUNS);
+  numLoops = harness.iterations(NUM_LOOPS);
+  const int numThreads = harness.threads(4, MAX_THREADS);
+  if (numThreads % 2) {
+    std::fprintf(stderr, "locks needs an even number of threads\n");
+    return 1;
   }
-  clock_gettime(CLOCK_REALTIME, &tpEnd1);
-
-  auto time1 = compute(tpBegin1, tpEnd1);
 
-  printf("Average time taken over %d runs with false sharing      : %f ms\n",
-         NUM_RUNS, time1 / NUM_RUNS);
+  // Threads 0 and 1 produce for and consume from queue 1, threads 2 and 3
+  // for queue 2, threads 4 and 5 for queue 1 again, and so on, so every
+  // queue has as many producers as consumers.
+  harness.run("with false sharing", numThreads, [](int thread) {
+    const int queue = thread / 2 % 2 + 1;
+    if (thread % 2 == 0) {
+      producer(queue);
+    } else {
+      consumer(queue);
+    }
+  });
 
-  return 0;
+  return harness.report();
 }
@@ -0,0 +1,66 @@
+// Reference-counted shared configuration, as with std::shared_ptr: some
+// threads keep taking and dropping references while others only read the
+// configuration through a reference they already hold. The count is declared
+// next to the read-mostly lookup table, so each change of the count evicts the
+// table from the readers' caches although the table never changes.
+
+#include <atomic>
+#include <cstdio>
+
+#include "fs_bench.h"
+
+namespace {
+const int TABLE_SIZE = 12;
+
+struct Config {
+  std::atomic<long> refs;
+  int table[TABLE_SIZE];
+};
+
+struct PaddedConfig {
+  alignas(64) std::atomic<long> refs;
+  alignas(64) int table[TABLE_SIZE];
+};
+} // namespace
+
+const int MAX_THREADS = 64;
+const int NUM_LOOPS = 1000000;
+const int NUM_RUNS = 10;
+
+Config config{{1}, {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37}};
+PaddedConfig paddedConfig{{1}, {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37}};
+std::atomic<long> checksum{0};
+
+long numLoops;
+
+// Even threads take and drop references; odd threads read the table
+template <typename Shared> void runThread(Shared &shared, int thread) {
+  if (thread % 2 == 0) {
+    for (long i = 0; i < numLoops; ++i) {
+      shared.refs.fetch_add(1, std::memory_order_relaxed);
+      shared.refs.fetch_sub(1, std::memory_order_acq_rel);
+    }
+  } else {
+    long sum = 0;
+    for (long i = 0; i < numLoops; ++i) {
+      // volatile so the loads are not hoisted out of the loop
+      sum += *static_cast<volatile int *>(&shared.table[i % TABLE_SIZE]);
+    }
+    checksum.fetch_add(sum, std::memory_order_relaxed);
+  }
+}
+
+int main(int argc, char **argv) {
+  fs_bench::Harness harness("refCount", argc, argv, NUM_RUNS);
+  numLoops = harness.iterations(NUM_LOOPS);
+  const int numThreads = harness.threads(4, MAX_THREADS);
+
+  harness.run("with false sharing", numThreads,
+              [](int thread) { runThread(config, thread); });
+  harness.run("without false sharing", numThreads,
+              [](int thread) { runThread(paddedConfig, thread); });
+
+  printf("references: %ld, %ld, checksum: %ld\n", config.refs.load(),
+         paddedConfig.refs.load(), checksum.load());
+  return harness.report();
+}
@@ -0,0 +1,128 @@
+// Bounded multi-producer multi-consumer ring buffer (after Vyukov's design):
+// producers claim cells by advancing the tail index and consumers by advancing
+// the head index. Declared next to each other, the two indices share a line,
+// so every enqueue slows down every dequeue and vice versa.
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+#include "fs_bench.h"
+
+namespace {
+const size_t CAPACITY = 1024; // a power of two
+
+struct Cell {
+  std::atomic<size_t> sequence;
+  long value;
+};
+
+struct RingBuffer {
+  std::atomic<size_t> head; // next cell to dequeue
+  std::atomic<size_t> tail; // next cell to enqueue
+  Cell cells[CAPACITY];
+};
+
+struct PaddedRingBuffer {
+  alignas(64) std::atomic<size_t> head;
+  alignas(64) std::atomic<size_t> tail;
+  alignas(64) Cell cells[CAPACITY];
+};
+
+template <typename Queue> void init(Queue &q) {
+  for (size_t i = 0; i < CAPACITY; ++i)
+    q.cells[i].sequence.store(i, std::memory_order_relaxed);
+  q.head.store(0, std::memory_order_relaxed);
+  q.tail.store(0, std::memory_order_relaxed);
+}
+
+template <typename Queue> bool enqueue(Queue &q, long value) {
+  size_t pos = q.tail.load(std::memory_order_relaxed);
+  for (;;) {
+    Cell &cell = q.cells[pos & (CAPACITY - 1)];
+    size_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if (sequence == pos) {
+      if (q.tail.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed)) {
+        cell.value = value;
+        cell.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (sequence < pos) {
+      return false; // full
+    } else {
+      pos = q.tail.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template <typename Queue> bool dequeue(Queue &q, long &value) {
+  size_t pos = q.head.load(std::memory_order_relaxed);
+  for (;;) {
+    Cell &cell = q.cells[pos & (CAPACITY - 1)];
+    size_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if (sequence == pos + 1) {
+      if (q.head.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed)) {
+        value = cell.value;
+        cell.sequence.store(pos + CAPACITY, std::memory_order_release);
+        return true;
+      }
+    } else if (sequence < pos + 1) {
+      return false; // empty
+    } else {
+      pos = q.head.load(std::memory_order_relaxed);
+    }
+  }
+}
+} // namespace
+
+const int MAX_THREADS = 64;
+const int NUM_LOOPS = 100000;
+const int NUM_RUNS = 10;
+
+RingBuffer queue;
+PaddedRingBuffer paddedQueue;
+std::atomic<long> checksum{0};
+
+long numLoops;
+
+// Even threads produce numLoops values and odd threads consume as many, so
+// every trial drains the queue.
+template <typename Queue> void runThread(Queue &q, int thread) {
+  if (thread % 2 == 0) {
+    for (long i = 0; i < numLoops; ++i) {
+      while (!enqueue(q, i))
+        std::this_thread::yield();
+    }
+  } else {
+    long sum = 0;
+    long value;
+    for (long i = 0; i < numLoops; ++i) {
+      while (!dequeue(q, value))
+        std::this_thread::yield();
+      sum += value;
+    }
+    checksum.fetch_add(sum, std::memory_order_relaxed);
+  }
+}
+
+int main(int argc, char **argv) {
+  fs_bench::Harness harness("ringBuffer", argc, argv, NUM_RUNS);
+  numLoops = harness.iterations(NUM_LOOPS);
+  const int numThreads = harness.threads(4, MAX_THREADS);
+  if (numThreads % 2) {
+    std::fprintf(stderr, "ringBuffer needs an even number of threads\n");
+    return 1;
+  }
+  init(queue);
+  init(paddedQueue);
+
+  harness.run("with false sharing", numThreads,
+              [](int thread) { runThread(queue, thread); });
+  harness.run("without false sharing", numThreads,
+              [](int thread) { runThread(paddedQueue, thread); });
+
+  printf("checksum: %ld\n", checksum.load());
+  return harness.report();
+}
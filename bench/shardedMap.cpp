@@ -0,0 +1,91 @@
+// Sharded hash map: keys are spread over shards that each have their own lock,
+// so threads updating different shards should not contend. The locks are kept
+// together in one array, though, and several of them fit in a cache line, so
+// taking one lock invalidates the line holding its neighbors.
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+
+#include "fs_bench.h"
+
+namespace {
+const int NUM_SHARDS = 64;
+const int NUM_KEYS = 4096;
+// Twice the keys a shard gets on average, so that linear probing stays short
+const int SHARD_CAPACITY = 2 * NUM_KEYS / NUM_SHARDS;
+
+struct Shard {
+  uint64_t keys[SHARD_CAPACITY]; // key + 1, or 0 for an empty slot
+  uint64_t counts[SHARD_CAPACITY];
+};
+
+struct alignas(64) PaddedMutex {
+  std::mutex m;
+};
+} // namespace
+
+const int MAX_THREADS = 64;
+const int NUM_LOOPS = 100000;
+const int NUM_RUNS = 10;
+
+std::mutex shardLocks[NUM_SHARDS];
+PaddedMutex paddedShardLocks[NUM_SHARDS];
+Shard shards[NUM_SHARDS];
+
+long numLoops;
+
+uint64_t hash(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdull;
+  key ^= key >> 33;
+  return key;
+}
+
+// Counts an occurrence of key in its shard, which the caller has locked
+void increment(Shard &shard, uint64_t key, uint64_t h) {
+  int slot = (h / NUM_SHARDS) % SHARD_CAPACITY;
+  while (shard.keys[slot] && shard.keys[slot] != key + 1)
+    slot = (slot + 1) % SHARD_CAPACITY;
+  shard.keys[slot] = key + 1;
+  shard.counts[slot]++;
+}
+
+template <typename LockOf> void runThread(int thread, LockOf lockOf) {
+  fs_bench::Random random(thread);
+  for (long i = 0; i < numLoops; ++i) {
+    const uint64_t key = random.next() % NUM_KEYS;
+    const uint64_t h = hash(key);
+    const int shard = h % NUM_SHARDS;
+    std::lock_guard<std::mutex> guard(lockOf(shard));
+    increment(shards[shard], key, h);
+  }
+}
+
+uint64_t totalCount() {
+  uint64_t total = 0;
+  for (const Shard &shard : shards)
+    for (uint64_t count : shard.counts)
+      total += count;
+  return total;
+}
+
+int main(int argc, char **argv) {
+  fs_bench::Harness harness("shardedMap", argc, argv, NUM_RUNS);
+  numLoops = harness.iterations(NUM_LOOPS);
+  const int numThreads = harness.threads(4, MAX_THREADS);
+
+  harness.run("with false sharing", numThreads, [](int thread) {
+    runThread(thread, [](int shard) -> std::mutex & {
+      return shardLocks[shard];
+    });
+  });
+  harness.run("without false sharing", numThreads, [](int thread) {
+    runThread(thread, [](int shard) -> std::mutex & {
+      return paddedShardLocks[shard].m;
+    });
+  });
+
+  printf("updates: %llu\n", static_cast<unsigned long long>(totalCount()));
+  return harness.report();
+}
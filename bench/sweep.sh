@@ -0,0 +1,91 @@
+#!/bin/bash
+# Runs a benchmark with 1 to N threads, with and without the fix pass, and
+# prints the scaling curve as CSV on stdout:
+#
+#   threads,case,baseline_ms,baseline_ci95_ms,fixed_ms,fixed_ci95_ms,speedup,
+#   baseline_iterations_per_s,fixed_iterations_per_s
+#
+# Times are medians over the harness trials (see fs_bench.h). Iterations per
+# second are only given for benchmarks that read --iterations.
+#
+# Usage (from the repository root, after run.sh has left a profile there):
+#   bench/sweep.sh <benchmark> [max threads] [benchmark options...]
+#   e.g. bench/sweep.sh sharedArray 8 --iterations 1000000 --trials 5
+#
+# The fixed binary is built with src/run.sh, which reads mapped_profile.fsp
+# or mapped_conflicts.out from the current directory. Without a profile only
+# the baseline is swept. The baseline is compiled like src/run.sh compiles,
+# without running a pass.
+set -Eeuo pipefail
+
+usage() {
+    >&2 echo "Usage: bench/sweep.sh <benchmark> [max threads] [benchmark options...]"
+    exit 1
+}
+
+if [ $# -lt 1 ]; then
+    usage
+fi
+
+BENCH_DIR="$(dirname -- "${BASH_SOURCE[0]}")"
+source "${BENCH_DIR}/harness.sh"
+NAME=${1}
+shift
+MAX_THREADS=$(nproc)
+if [ $# -gt 0 ] && [[ ${1} =~ ^[0-9]+$ ]]; then
+    MAX_THREADS=${1}
+    shift
+fi
+BENCH_ARGS=("$@")
+
+SWEEP_DIR=$(mktemp -d)
+trap 'rm -rf "${SWEEP_DIR}"' EXIT
+
+>&2 echo "Building ${NAME} baseline..."
+build_baseline "${BENCH_DIR}/${NAME}.cpp" "${SWEEP_DIR}/baseline"
+
+VARIANTS=(baseline)
+if [ -f mapped_profile.fsp ] || [ -f mapped_conflicts.out ]; then
+    >&2 echo "Building ${NAME} with the fix pass..."
+    "${BENCH_DIR}/../src/run.sh" "${BENCH_DIR}/${NAME}" fix > "${SWEEP_DIR}/fix.log" 2>&1 ||
+        { >&2 cat "${SWEEP_DIR}/fix.log"; exit 1; }
+    cp "${BENCH_DIR}/../src/build/run/${NAME}_fix" "${SWEEP_DIR}/fixed"
+    VARIANTS+=(fixed)
+else
+    >&2 echo "No profile in $(pwd); sweeping the baseline only"
+fi
+
+for ((threads = 1; threads <= MAX_THREADS; threads++)); do
+    for variant in "${VARIANTS[@]}"; do
+        >&2 echo "Running ${variant} with ${threads} threads..."
+        "${SWEEP_DIR}/${variant}" --threads "${threads}" "${BENCH_ARGS[@]}" \
+            --json "${SWEEP_DIR}/${variant}.${threads}.json" > /dev/null
+        harness_cases "${SWEEP_DIR}/${variant}.${threads}.json" > "${SWEEP_DIR}/${variant}.${threads}.tsv"
+    done
+done
+
+echo "threads,case,baseline_ms,baseline_ci95_ms,fixed_ms,fixed_ci95_ms,speedup,baseline_iterations_per_s,fixed_iterations_per_s"
+for ((threads = 1; threads <= MAX_THREADS; threads++)); do
+    # Cases are matched by name; the fixed columns are empty without a profile.
+    # Rates count the iterations of all threads, even in serial cases.
+    awk -F '\t' -v threads="${threads}" -v fixedFile="${SWEEP_DIR}/fixed.${threads}.tsv" '
+        function rate(iterations, ms) {
+            return (iterations > 0 && ms > 0) ? sprintf("%.0f", threads * iterations / ms * 1000) : ""
+        }
+        BEGIN {
+            while ((getline line < fixedFile) > 0) {
+                split(line, f, "\t")
+                fixed[f[2]] = line
+            }
+        }
+        {
+            fixedMs = fixedCi = speedup = fixedRate = ""
+            if ($2 in fixed) {
+                split(fixed[$2], f, "\t")
+                fixedMs = f[3]; fixedCi = f[4]
+                speedup = f[3] > 0 ? sprintf("%.3f", $3 / f[3]) : ""
+                fixedRate = rate(f[5], f[3])
+            }
+            printf "%s,\"%s\",%s,%s,%s,%s,%s,%s,%s\n", threads, $2, $3, $4, fixedMs, fixedCi, speedup, rate($5, $3), fixedRate
+        }' "${SWEEP_DIR}/baseline.${threads}.tsv"
+done
@@ -0,0 +1,83 @@
+// Thread pool: workers take task indices from a shared counter and keep their
+// own bookkeeping (tasks done, time busy, last task) in a std::vector indexed
+// by worker. The per-worker entries are small and contiguous, so workers keep
+// invalidating each other's lines while updating their own state.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "fs_bench.h"
+
+namespace {
+struct WorkerState {
+  long tasksDone;
+  long busyTicks;
+  long lastTask;
+};
+
+struct alignas(64) PaddedWorkerState {
+  long tasksDone;
+  long busyTicks;
+  long lastTask;
+};
+} // namespace
+
+const int MAX_THREADS = 64;
+const int NUM_LOOPS = 100000;
+const int NUM_RUNS = 10;
+
+std::atomic<long> nextTask;
+std::atomic<long> checksum{0};
+
+long numTasks;
+
+// Cheap stand-in for a task body
+long runTask(long task) {
+  long x = task;
+  for (int i = 0; i < 8; ++i)
+    x = x * 6364136223846793005l + 1442695040888963407l;
+  return x;
+}
+
+template <typename State> void worker(std::vector<State> &states, int thread) {
+  volatile State &state = states[thread];
+  long sum = 0;
+  for (long task; (task = nextTask.fetch_add(1, std::memory_order_relaxed)) <
+                  numTasks;) {
+    const auto start = std::chrono::steady_clock::now();
+    sum += runTask(task);
+    const auto end = std::chrono::steady_clock::now();
+    state.tasksDone = state.tasksDone + 1;
+    state.busyTicks = state.busyTicks + (end - start).count();
+    state.lastTask = task;
+  }
+  checksum.fetch_add(sum, std::memory_order_relaxed);
+}
+
+template <typename State>
+void runPool(fs_bench::Harness &harness, const char *caseName,
+             int numThreads) {
+  std::vector<State> states(numThreads);
+  harness.run(
+      caseName, numThreads, [&](int thread) { worker(states, thread); },
+      [] { nextTask.store(0); });
+  long done = 0;
+  for (const State &state : states)
+    done += state.tasksDone;
+  printf("%s: %ld tasks done\n", caseName, done);
+}
+
+int main(int argc, char **argv) {
+  fs_bench::Harness harness("threadPool", argc, argv, NUM_RUNS);
+  // each worker runs numLoops tasks on average
+  const int numThreads = harness.threads(4, MAX_THREADS);
+  numTasks = harness.iterations(NUM_LOOPS) * numThreads;
+
+  runPool<WorkerState>(harness, "with false sharing", numThreads);
+  runPool<PaddedWorkerState>(harness, "without false sharing", numThreads);
+
+  printf("checksum: %ld\n", checksum.load());
+  return harness.report();
+}
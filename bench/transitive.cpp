@@ -1,7 +1,4 @@
-#include <iostream>
-#include <sys/times.h>
-#include <thread>
-#include <time.h>
+#include "fs_bench.h"
 
 namespace {
 volatile int thread_data1 = 0;
@@ -13,40 +10,21 @@ volatile int thread_data4 = 0;
 const int NUM_LOOPS = 100000;
 const int NUM_RUNS = 1;
 
-double compute(struct timespec start, struct timespec end) {
-  double t;
-  t = (end.tv_sec - start.tv_sec) * 1000;
-  t += (end.tv_nsec - start.tv_nsec) * 0.000001;
-  return t;
-}
+long numLoops;
 
 void runThread(volatile int *threadData) {
-  for (int i = 0; i < NUM_LOOPS; ++i) {
+  for (long i = 0; i < numLoops; ++i) {
     ++(*threadData);
   }
 }
 
-int main() {
-  timespec tpBegin1, tpEnd1;
-  volatile int *thread1_data;
-  volatile int *thread2_data;
-  int data_choice1, data_choice2;
-
-  clock_gettime(CLOCK_REALTIME, &tpBegin1);
-  for (int i = 0; i < NUM_RUNS; i++) {
-    std::thread thread1{runThread, &thread_data1};
-    std::thread thread2{runThread, &thread_data2};
-    std::thread thread3{runThread, &thread_data3};
-    thread1.join();
-    thread2.join();
-    thread3.join();
-  }
-  clock_gettime(CLOCK_REALTIME, &tpEnd1);
-
-  auto time1 = compute(tpBegin1, tpEnd1);
+int main(int argc, char **argv) {
+  fs_bench::Harness harness("transitive", argc, argv, NUM_RUNS);
+  numLoops = harness.iterations(NUM_LOOPS);
 
-  printf("Average time taken over %d runs: %f ms\n", NUM_RUNS,
-         time1 / NUM_RUNS);
+  volatile int *data[] = {&thread_data1, &thread_data2, &thread_data3};
+  harness.run("transitive conflicts", 3,
+              [&](int thread) { runThread(data[thread]); });
 
-  return 0;
+  return harness.report();
 }
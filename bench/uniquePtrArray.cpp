@@ -0,0 +1,56 @@
+// Per-thread slots in a heap array owned by a std::unique_ptr: each thread
+// accumulates into its own slot, but the slots are packed together, so the
+// threads' writes contend for the same cache lines.
+
+#include <cstdio>
+#include <memory>
+
+#include "fs_bench.h"
+
+namespace {
+struct Slot {
+  int sum = 0;
+};
+
+struct alignas(64) PaddedSlot {
+  int sum = 0;
+};
+} // namespace
+
+const int MAX_THREADS = 64;
+const int NUM_LOOPS = 1000000;
+const int NUM_RUNS = 10;
+
+long numLoops;
+
+template <typename T> void runThread(T *slots, int thread) {
+  volatile int &sum = slots[thread].sum;
+  for (long i = 0; i < numLoops; ++i) {
+    sum = sum + static_cast<int>(i & 1);
+  }
+}
+
+template <typename T>
+void runCase(fs_bench::Harness &harness, const char *caseName,
+             int numThreads) {
+  std::unique_ptr<T[]> slots = std::make_unique<T[]>(numThreads);
+  harness.run(caseName, numThreads,
+              [&](int thread) { runThread(slots.get(), thread); });
+
+  long total = 0;
+  for (int i = 0; i < numThreads; ++i) {
+    total += slots[i].sum;
+  }
+  printf("%s: sum %ld\n", caseName, total);
+}
+
+int main(int argc, char **argv) {
+  fs_bench::Harness harness("uniquePtrArray", argc, argv, NUM_RUNS);
+  numLoops = harness.iterations(NUM_LOOPS);
+  const int numThreads = harness.threads(2, MAX_THREADS);
+
+  runCase<Slot>(harness, "with false sharing", numThreads);
+  runCase<PaddedSlot>(harness, "without false sharing", numThreads);
+
+  return harness.report();
+}
@@ -0,0 +1,66 @@
+// Per-thread statistics in a std::vector indexed by thread: the elements are
+// contiguous on the heap, so threads updating their own element write to the
+// same cache lines as their neighbors.
+
+#include <cstdio>
+#include <vector>
+
+#include "fs_bench.h"
+
+namespace {
+struct Counter {
+  long hits = 0;
+  long misses = 0;
+};
+
+struct alignas(64) PaddedCounter {
+  long hits = 0;
+  long misses = 0;
+};
+} // namespace
+
+const int MAX_THREADS = 64;
+const int NUM_LOOPS = 1000000;
+const int NUM_RUNS = 10;
+
+long numLoops;
+
+template <typename T> void runThread(T &counter, int thread) {
+  volatile long &hits = counter.hits;
+  volatile long &misses = counter.misses;
+  fs_bench::Random random(thread);
+  for (long i = 0; i < numLoops; ++i) {
+    if (random.next() % 4) {
+      hits = hits + 1;
+    } else {
+      misses = misses + 1;
+    }
+  }
+}
+
+template <typename T>
+void runCase(fs_bench::Harness &harness, const char *caseName,
+             int numThreads) {
+  std::vector<T> counters(numThreads);
+  harness.run(caseName, numThreads,
+              [&](int thread) { runThread(counters[thread], thread); });
+
+  long hits = 0;
+  long misses = 0;
+  for (const T &counter : counters) {
+    hits += counter.hits;
+    misses += counter.misses;
+  }
+  printf("%s: %ld hits, %ld misses\n", caseName, hits, misses);
+}
+
+int main(int argc, char **argv) {
+  fs_bench::Harness harness("vectorCounters", argc, argv, NUM_RUNS);
+  numLoops = harness.iterations(NUM_LOOPS);
+  const int numThreads = harness.threads(2, MAX_THREADS);
+
+  runCase<Counter>(harness, "with false sharing", numThreads);
+  runCase<PaddedCounter>(harness, "without false sharing", numThreads);
+
+  return harness.report();
+}
@@ -0,0 +1,121 @@
+// Work-stealing scheduler: each worker pushes and pops tasks at the bottom of
+// its own Chase-Lev deque while idle workers steal from the top of others'.
+// The owner writes bottom on every push and pop, and thieves compare-and-swap
+// top; with both indices on one line, every steal attempt invalidates the
+// owner's copy of bottom even when the deque has plenty of work.
+
+#include <atomic>
+#include <cstdio>
+
+#include "fs_bench.h"
+
+namespace {
+const long CAPACITY = 256;
+const long EMPTY = -1;
+
+struct WorkDeque {
+  std::atomic<long> top;    // thieves steal here
+  std::atomic<long> bottom; // the owner pushes and pops here
+  std::atomic<long> tasks[CAPACITY];
+};
+
+struct PaddedWorkDeque {
+  alignas(64) std::atomic<long> top;
+  alignas(64) std::atomic<long> bottom;
+  alignas(64) std::atomic<long> tasks[CAPACITY];
+};
+
+template <typename Deque> void push(Deque &d, long task) {
+  long b = d.bottom.load(std::memory_order_relaxed);
+  d.tasks[b % CAPACITY].store(task, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  d.bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+template <typename Deque> long pop(Deque &d) {
+  long b = d.bottom.load(std::memory_order_relaxed) - 1;
+  d.bottom.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  long t = d.top.load(std::memory_order_relaxed);
+  if (t > b) {
+    d.bottom.store(b + 1, std::memory_order_relaxed);
+    return EMPTY;
+  }
+  long task = d.tasks[b % CAPACITY].load(std::memory_order_relaxed);
+  if (t == b) {
+    // last task: race the thieves for it
+    if (!d.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed))
+      task = EMPTY;
+    d.bottom.store(b + 1, std::memory_order_relaxed);
+  }
+  return task;
+}
+
+template <typename Deque> long steal(Deque &d) {
+  long t = d.top.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  long b = d.bottom.load(std::memory_order_acquire);
+  if (t >= b)
+    return EMPTY;
+  long task = d.tasks[t % CAPACITY].load(std::memory_order_relaxed);
+  if (!d.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed))
+    return EMPTY;
+  return task;
+}
+} // namespace
+
+const int MAX_THREADS = 64;
+const int NUM_LOOPS = 100000;
+const int NUM_RUNS = 10;
+const int BATCH = 64;        // tasks pushed at a time, less than CAPACITY
+const int STEAL_PERIOD = 16; // tasks run between steal attempts
+
+WorkDeque deques[MAX_THREADS];
+PaddedWorkDeque paddedDeques[MAX_THREADS];
+std::atomic<long> tasksRun{0};
+std::atomic<long> checksum{0};
+
+long numLoops;
+int numThreads;
+
+// Runs numLoops tasks of its own, in batches, and tries to steal a task from
+// its neighbor every STEAL_PERIOD tasks. Every task pushed is run exactly once,
+// by its owner or by a thief, so tasksRun checks the deques.
+template <typename Deque> void worker(Deque *all, int thread) {
+  Deque &own = all[thread];
+  Deque &victim = all[(thread + 1) % numThreads];
+  long sum = 0;
+  long run = 0;
+  for (long pushed = 0; pushed < numLoops; pushed += BATCH) {
+    for (long i = pushed; i < pushed + BATCH && i < numLoops; ++i)
+      push(own, i);
+    for (long task; (task = pop(own)) != EMPTY;) {
+      sum += task;
+      if (++run % STEAL_PERIOD == 0 && numThreads > 1) {
+        long stolen = steal(victim);
+        if (stolen != EMPTY) {
+          sum += stolen;
+          ++run;
+        }
+      }
+    }
+  }
+  tasksRun.fetch_add(run, std::memory_order_relaxed);
+  checksum.fetch_add(sum, std::memory_order_relaxed);
+}
+
+int main(int argc, char **argv) {
+  fs_bench::Harness harness("workStealing", argc, argv, NUM_RUNS);
+  numLoops = harness.iterations(NUM_LOOPS);
+  numThreads = harness.threads(4, MAX_THREADS);
+
+  harness.run("with false sharing", numThreads,
+              [](int thread) { worker(deques, thread); });
+  harness.run("without false sharing", numThreads,
+              [](int thread) { worker(paddedDeques, thread); });
+
+  printf("tasks run: %ld, checksum %ld\n", tasksRun.load(), checksum.load());
+  return harness.report();
+}
@@ -0,0 +1,148 @@
+#!/bin/bash
+# Evaluates the fix pass on benchmarks. For each benchmark, runs run.sh to
+# profile it and build the fixed binary, builds a baseline without any pass,
+# then compares the two:
+#   - speedup: median time of each harness case, baseline over fixed, running
+#     natively (see bench/fs_bench.h)
+#   - tombstone reduction: cache line invalidations seen by mdcache, from
+#     pre_mdcache.out and post_mdcache.out
+#   - data growth: size of the .data and .bss sections of the fixed binary
+#     relative to the baseline
+#   - detection accuracy: precision and recall of mapped_conflicts.out for
+#     benchmarks annotated in bench/expected/<benchmark>.truth (pin/accuracy)
+# The table is printed and saved in evaluation/summary.csv, with each
+# benchmark's outputs kept in evaluation/<benchmark>. Exits with failure if the
+# fix slows down any case by more than TOLERANCE percent and by more than the
+# 95% confidence intervals of the two means together, or if a benchmark with
+# expected results in bench/expected computes different results once fixed.
+#
+# Usage: ./evaluate.sh [benchmark...]   (all benchmarks in bench/ by default)
+# Environment:
+#   TOLERANCE    slowdown allowed before a case counts as a regression (5)
+#   EVALARGS     harness options for the native runs, e.g. "--trials 20"
+#   and PATH_TO_PIN, CACHELINESIZE as for run.sh
+set -Eeuo pipefail
+
+REPO_ROOT=$(pwd)
+source "${REPO_ROOT}/bench/harness.sh"
+
+TOLERANCE=${TOLERANCE:-5}
+read -r -a EVAL_ARGS <<< "${EVALARGS:-}"
+EVAL_DIR=${REPO_ROOT}/evaluation
+
+BENCHES=("$@")
+if [ ${#BENCHES[@]} -eq 0 ]; then
+    for source in "${REPO_ROOT}"/bench/*.cpp; do
+        BENCHES+=("$(basename "${source}" .cpp)")
+    done
+fi
+
+# Sum of the Total-Tombstones lines of all cores in an mdcache.out
+tombstones() {
+    awk '/Total-Tombstones:/ { sum += $3 } END { print sum + 0 }' "${1}"
+}
+
+# Bytes of initialized and zero-initialized data in a binary
+data_size() {
+    size "${1}" | awk 'NR == 2 { print $2 + $3 }'
+}
+
+# Prints a CSV file as aligned columns. Fields must not contain commas.
+print_table() {
+    awk -F ',' '
+        FNR == NR { for (i = 1; i <= NF; i++) if (length($i) > width[i]) width[i] = length($i); next }
+        { line = ""; for (i = 1; i <= NF; i++) line = line sprintf("%-*s  ", width[i], $i); sub(/ +$/, "", line); print line }
+    ' "${1}" "${1}"
+}
+
+RESULTS_DIFFER=()
+ACCURACY_PAIRS=()
+
+rm -rf "${EVAL_DIR}"
+mkdir -p "${EVAL_DIR}"
+SUMMARY=${EVAL_DIR}/summary.csv
+echo "benchmark,case,baseline_ms,fixed_ms,speedup,tombstones_before,tombstones_after,tombstone_reduction_pct,data_bytes_before,data_bytes_after,data_growth_pct,regression" > "${SUMMARY}"
+
+for bench in "${BENCHES[@]}"; do
+    out=${EVAL_DIR}/${bench}
+    mkdir -p "${out}"
+
+    echo "Profiling and fixing ${bench} (log in ${out}/run.log)..."
+    if ! BENCHNAME=${bench} ./run.sh > "${out}/run.log" 2>&1; then
+        echo "run.sh failed for ${bench}; see ${out}/run.log"
+        exit 1
+    fi
+    cp pre_mdcache.out post_mdcache.out mapped_conflicts.out mapped_lines.out mapped_affinity.out "${out}"
+    cp "src/build/run/${bench}_fix" "${out}/fixed"
+    build_baseline "bench/${bench}.cpp" "${out}/baseline"
+
+    echo "Timing ${bench}..."
+    for variant in baseline fixed; do
+        "${out}/${variant}" "${EVAL_ARGS[@]}" --json "${out}/${variant}.json" > "${out}/${variant}.log"
+        harness_cases "${out}/${variant}.json" > "${out}/${variant}.tsv"
+    done
+
+    truth=bench/expected/${bench}.truth
+    if [ -f "${truth}" ]; then
+        ACCURACY_PAIRS+=("${truth}" "${out}/mapped_conflicts.out")
+    fi
+
+    expected=bench/expected/${bench}.out
+    if [ -f "${expected}" ]; then
+        for variant in baseline fixed; do
+            if ! bench/check.sh "${out}/${variant}" "${expected}" > "${out}/${variant}.check" 2>&1; then
+                RESULTS_DIFFER+=("${bench} (${variant})")
+            fi
+        done
+    fi
+
+    awk -F '\t' -v OFS=',' -v bench="${bench}" -v tolerance="${TOLERANCE}" \
+        -v fixedFile="${out}/fixed.tsv" \
+        -v tombstonesBefore="$(tombstones "${out}/pre_mdcache.out")" \
+        -v tombstonesAfter="$(tombstones "${out}/post_mdcache.out")" \
+        -v dataBefore="$(data_size "${out}/baseline")" \
+        -v dataAfter="$(data_size "${out}/fixed")" '
+        # Change from before to after, as a percentage of before
+        function percent(before, after) {
+            return before > 0 ? sprintf("%.1f", 100 * (after - before) / before) : ""
+        }
+        BEGIN {
+            while ((getline line < fixedFile) > 0) {
+                split(line, f, "\t")
+                fixed[f[2]] = f[3]
+                fixedCi[f[2]] = f[4]
+            }
+            removed = tombstonesBefore - tombstonesAfter
+            tombstoneReduction = tombstonesBefore > 0 ? sprintf("%.1f", 100 * removed / tombstonesBefore) : ""
+        }
+        {
+            fixedMs = ($2 in fixed) ? fixed[$2] : ""
+            speedup = fixedMs > 0 ? sprintf("%.3f", $3 / fixedMs) : ""
+            slower = fixedMs != "" && fixedMs > $3 * (1 + tolerance / 100)
+            regression = (slower && fixedMs - $3 > $4 + fixedCi[$2]) ? "yes" : "no"
+            print bench, "\"" $2 "\"", $3, fixedMs, speedup, tombstonesBefore, tombstonesAfter,
+                  tombstoneReduction, dataBefore, dataAfter, percent(dataBefore, dataAfter), regression
+        }' "${out}/baseline.tsv" >> "${SUMMARY}"
+done
+
+echo
+print_table "${SUMMARY}"
+echo
+echo "Saved to ${SUMMARY}"
+
+if [ ${#ACCURACY_PAIRS[@]} -gt 0 ]; then
+    make -s -C pin/accuracy accuracy
+    echo
+    pin/accuracy/accuracy "${ACCURACY_PAIRS[@]}" | tee "${EVAL_DIR}/accuracy.txt"
+fi
+
+STATUS=0
+if grep -q ',yes$' "${SUMMARY}"; then
+    echo "The fix slowed down some cases by more than ${TOLERANCE}%"
+    STATUS=1
+fi
+if [ ${#RESULTS_DIFFER[@]} -gt 0 ]; then
+    echo "Results differ from bench/expected for: ${RESULTS_DIFFER[*]}"
+    STATUS=1
+fi
+exit ${STATUS}
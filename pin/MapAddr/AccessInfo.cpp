@@ -8,3 +8,30 @@ bool operator==(const conflicting_addr &left, const conflicting_addr &right) {
 bool operator<(const global_var &left, const global_var &right) {
   return left.start_addr < right.start_addr;
 }
+
+sharing_kind classify(const line_sharing &line) {
+  if (line.true_count == 0) {
+    return sharing_kind::false_sharing;
+  }
+  if (line.false_count == 0) {
+    return sharing_kind::true_sharing;
+  }
+  return sharing_kind::mixed;
+}
+
+const char *sharing_kind_name(sharing_kind kind) {
+  switch (kind) {
+  case sharing_kind::false_sharing:
+    return "false";
+  case sharing_kind::true_sharing:
+    return "true";
+  case sharing_kind::mixed:
+    return "mixed";
+  }
+  return "unknown";
+}
+
+double true_sharing_fraction(const line_sharing &line) {
+  const uint64_t total = line.false_count + line.true_count;
+  return total ? static_cast<double>(line.true_count) / total : 0.0;
+}
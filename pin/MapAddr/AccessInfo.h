@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 struct global_var {
@@ -18,8 +19,57 @@ struct conflicting_access {
   memory_access var1;
   memory_access var2;
   uint64_t priority;
+  double samples; // number of sampled events behind priority
+  // Fraction of the sharing on the conflict's cache line that is true
+  // sharing, which padding cannot remove; 0 if unknown
+  double true_sharing = 0;
 };
 
+// Number of interferences seen between two addresses
+struct interference_count {
+  uint64_t addr1;
+  uint64_t addr2;
+  uint64_t count;
+};
+
+// An access by a thread to an address on a line with interferences
+struct thread_access {
+  uint64_t addr;
+  uint64_t thread;
+  bool isWrite;
+};
+
+// Reads and writes by a thread to a range of bytes of a line with
+// interferences, at offset from the start of the line
+struct access_affinity {
+  uint64_t line_addr;
+  uint64_t thread;
+  uint64_t offset;
+  uint64_t size;
+  uint64_t reads;
+  uint64_t writes;
+};
+
+// Sharing between threads seen on a cache line: pairs of accesses by
+// different threads, at least one of them a write, to disjoint bytes (false
+// sharing) or to overlapping bytes (true sharing)
+struct line_sharing {
+  uint64_t line_addr;
+  uint64_t false_count;
+  uint64_t true_count;
+};
+
+enum class sharing_kind { false_sharing, true_sharing, mixed };
+
+// A line is mixed if it has both kinds of sharing
+sharing_kind classify(const line_sharing &line);
+
+// "false", "true" or "mixed"
+const char *sharing_kind_name(sharing_kind kind);
+
+// Fraction of the line's sharing that is true sharing
+double true_sharing_fraction(const line_sharing &line);
+
 struct conflicting_addr {
   uint64_t addr1;
   uint64_t addr2;
@@ -0,0 +1,304 @@
+#include "ConflictMapper.h"
+#include "../detect/InterferenceDetector.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <sstream>
+#include <unordered_map>
+
+std::vector<global_var> read_global_vars(std::istream &in) {
+  std::vector<global_var> global_vars;
+  std::string global_addr;
+  std::string global_name;
+  size_t size;
+  while (in >> global_name >> global_addr >> size) {
+    auto addr = string_to_uint64(global_addr, 16);
+    global_vars.push_back(global_var{global_name, addr, size});
+  }
+  std::sort(global_vars.begin(), global_vars.end());
+  return global_vars;
+}
+
+std::vector<interference_count> read_interferences(std::istream &in,
+                                                   double &scale) {
+  std::vector<interference_count> counts;
+  scale = 1.0;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.rfind("# sample ", 0) == 0) {
+      uint64_t sample_on = 0, sample_off = 0;
+      std::istringstream header(line.substr(9));
+      if (header >> sample_on >> sample_off && sample_on > 0) {
+        scale = static_cast<double>(sample_on + sample_off) / sample_on;
+      }
+      continue;
+    }
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream iss(line);
+    std::string addr1, addr2;
+    uint64_t count;
+    if (iss >> addr1 >> addr2 >> count) {
+      counts.push_back({string_to_uint64(addr1, 16),
+                        string_to_uint64(addr2, 16), count});
+    }
+  }
+  return counts;
+}
+
+std::vector<thread_access> read_thread_accesses(std::istream &in) {
+  std::vector<thread_access> accesses;
+  std::string addr, rw;
+  uint64_t thread;
+  while (in >> addr >> thread >> rw) {
+    accesses.push_back({string_to_uint64(addr, 16), thread, rw == "W"});
+  }
+  return accesses;
+}
+
+std::vector<line_sharing> read_line_sharing(std::istream &in,
+                                            uint64_t &cacheline_size) {
+  std::vector<line_sharing> lines;
+  cacheline_size = 0;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.rfind("# cacheline ", 0) == 0) {
+      cacheline_size = string_to_uint64(line.substr(12));
+      continue;
+    }
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream iss(line);
+    std::string addr;
+    uint64_t false_count, true_count;
+    if (iss >> addr >> false_count >> true_count) {
+      lines.push_back({string_to_uint64(addr, 16), false_count, true_count});
+    }
+  }
+  return lines;
+}
+
+std::vector<access_affinity> read_access_affinity(std::istream &in,
+                                                  uint64_t &cacheline_size) {
+  std::vector<access_affinity> accesses;
+  cacheline_size = 0;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.rfind("# cacheline ", 0) == 0) {
+      cacheline_size = string_to_uint64(line.substr(12));
+      continue;
+    }
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream iss(line);
+    std::string addr;
+    access_affinity access;
+    if (iss >> addr >> access.thread >> access.offset >> access.size >>
+        access.reads >> access.writes) {
+      access.line_addr = string_to_uint64(addr, 16);
+      accesses.push_back(access);
+    }
+  }
+  return accesses;
+}
+
+memory_access addr_to_named_access(uint64_t addr,
+                                   const std::vector<global_var> &global_vars) {
+  auto search_val = global_var{"", addr, 0};
+  auto it =
+      std::lower_bound(global_vars.begin(), global_vars.end(), search_val);
+
+  if (it == global_vars.end()) {
+    assert(global_vars.size() > 0);
+    it = global_vars.begin() + global_vars.size() - 1;
+  } else if (it->start_addr == addr) {
+    // no offset
+  } else if (it != global_vars.begin()) {
+    assert(it->start_addr > addr);
+    it--;
+  }
+
+  if (addr >= it->start_addr &&
+      addr < it->start_addr + it->size) { // TODO: Check overflow?
+    return {it->name, addr - it->start_addr, 1};
+  }
+  return {"", 0, 0};
+
+  // TODO: we always assume access of size 1 byte
+  // return {it->name, addr - it->start_addr, 1};
+}
+
+std::vector<conflicting_access>
+map_conflicts(const std::vector<global_var> &global_vars,
+              const std::vector<interference_count> &realized,
+              double realized_scale,
+              const std::vector<interference_count> &potential,
+              double potential_scale,
+              const std::vector<line_sharing> &lines,
+              uint64_t cacheline_size) {
+  std::unordered_map<conflicting_addr, conflicting_access> priority_cache;
+
+  // line index -> true sharing fraction
+  std::unordered_map<uint64_t, double> true_sharing;
+  if (cacheline_size > 0) {
+    for (auto &line : lines) {
+      true_sharing[line.line_addr / cacheline_size] =
+          true_sharing_fraction(line);
+    }
+  }
+
+  // Confidence in each conflict's priority is based on the number of sampled
+  // events behind it; unsampled counts are exact.
+  for (auto &count : realized) {
+    conflicting_addr addrs = {count.addr1, count.addr2};
+    conflicting_access ca;
+    ca.priority = count.count;
+    ca.samples = count.count / realized_scale;
+    ca.var1 = addr_to_named_access(count.addr1, global_vars);
+    ca.var2 = addr_to_named_access(count.addr2, global_vars);
+    if (ca.var1.name.empty() || ca.var2.name.empty()) {
+      continue;
+    }
+    if (priority_cache.count(addrs)) {
+      priority_cache[addrs].priority += 1;
+      priority_cache[addrs].samples += ca.samples;
+    } else {
+      priority_cache[addrs] = ca;
+    }
+  }
+
+  for (auto &count : potential) {
+    conflicting_addr addrs = {count.addr1, count.addr2};
+    conflicting_access ca;
+    ca.priority = count.count;
+    ca.samples = count.count / potential_scale;
+    ca.var1 = addr_to_named_access(count.addr1, global_vars);
+    ca.var2 = addr_to_named_access(count.addr2, global_vars);
+    if (ca.var1.name.empty() || ca.var2.name.empty()) {
+      continue;
+    }
+    if (priority_cache.count(addrs)) {
+      priority_cache[addrs].priority += count.count;
+      priority_cache[addrs].samples += ca.samples;
+    } else {
+      priority_cache[addrs] = ca;
+    }
+  }
+
+  std::vector<conflicting_access> conflicts;
+  conflicts.reserve(priority_cache.size());
+  for (auto &ca : priority_cache) {
+    if (!true_sharing.empty()) {
+      // Both addresses of an interference are on the same line
+      auto it = true_sharing.find(ca.first.addr1 / cacheline_size);
+      if (it != true_sharing.end()) {
+        ca.second.true_sharing = it->second;
+      }
+    }
+    conflicts.push_back(ca.second);
+  }
+  return conflicts;
+}
+
+mapped_thread_accesses
+map_thread_accesses(const std::vector<global_var> &global_vars,
+                    const std::vector<thread_access> &accesses) {
+  mapped_thread_accesses thread_accesses;
+  for (auto &access : accesses) {
+    auto ma = addr_to_named_access(access.addr, global_vars);
+    if (ma.name.empty()) {
+      continue;
+    }
+    thread_accesses[{ma.name, ma.accessOffset, access.thread}] |=
+        access.isWrite;
+  }
+  return thread_accesses;
+}
+
+mapped_access_affinity
+map_access_affinity(const std::vector<global_var> &global_vars,
+                    const std::vector<access_affinity> &accesses) {
+  mapped_access_affinity affinity;
+  for (auto &access : accesses) {
+    auto ma =
+        addr_to_named_access(access.line_addr + access.offset, global_vars);
+    if (ma.name.empty()) {
+      continue;
+    }
+    auto &counts = affinity[{ma.name, ma.accessOffset, access.thread}];
+    counts.size = std::max(counts.size, access.size);
+    counts.reads += access.reads;
+    counts.writes += access.writes;
+  }
+  return affinity;
+}
+
+void write_conflicts(std::ostream &out,
+                     const std::vector<conflicting_access> &conflicts,
+                     bool sampled) {
+  for (auto &ca : conflicts) {
+    auto &ma1 = ca.var1;
+    auto &ma2 = ca.var2;
+    out << ma1.name << " " << ma1.accessOffset << " " << ma1.accessSize << " "
+        << ma2.name << " " << ma2.accessOffset << " " << ma2.accessSize << " "
+        << ca.priority;
+    if (sampled) {
+      // Relative standard error of the priority, assuming the sampled
+      // events are Poisson distributed
+      out << " " << 1.0 / std::sqrt(std::max(ca.samples, 1.0));
+    }
+    out << std::endl;
+  }
+}
+
+void write_thread_accesses(std::ostream &out,
+                           const mapped_thread_accesses &accesses) {
+  for (auto &ta : accesses) {
+    out << std::get<0>(ta.first) << " " << std::get<1>(ta.first) << " "
+        << std::get<2>(ta.first) << " " << (ta.second ? "W" : "R")
+        << std::endl;
+  }
+}
+
+void write_line_sharing(std::ostream &out,
+                        const std::vector<line_sharing> &lines,
+                        const std::vector<global_var> &global_vars,
+                        uint64_t cacheline_size) {
+  for (auto &line : lines) {
+    // Globals do not overlap, so the ones on the line are the ones before its
+    // end that end after its start
+    const uint64_t line_end = line.line_addr + cacheline_size;
+    auto it = std::lower_bound(global_vars.begin(), global_vars.end(),
+                               global_var{"", line_end, 0});
+    std::vector<std::string> names;
+    while (it != global_vars.begin()) {
+      --it;
+      if (it->start_addr + it->size <= line.line_addr) {
+        break;
+      }
+      names.push_back(it->name);
+    }
+    if (names.empty()) {
+      continue;
+    }
+    out << sharing_kind_name(classify(line)) << " " << line.false_count << " "
+        << line.true_count;
+    for (auto name = names.rbegin(); name != names.rend(); ++name) {
+      out << " " << *name;
+    }
+    out << std::endl;
+  }
+}
+
+void write_access_affinity(std::ostream &out,
+                           const mapped_access_affinity &affinity) {
+  for (auto &entry : affinity) {
+    out << std::get<0>(entry.first) << " " << std::get<1>(entry.first) << " "
+        << entry.second.size << " " << std::get<2>(entry.first) << " "
+        << entry.second.reads << " " << entry.second.writes << std::endl;
+  }
+}
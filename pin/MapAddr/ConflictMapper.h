@@ -0,0 +1,100 @@
+#pragma once
+
+#include "AccessInfo.h"
+
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// <name, accessOffsetInVar, thread> -> written
+typedef std::map<std::tuple<std::string, uint64_t, uint64_t>, bool>
+    mapped_thread_accesses;
+
+// Reads and writes of a range of bytes in a global
+struct affinity_counts {
+  uint64_t size = 0;
+  uint64_t reads = 0;
+  uint64_t writes = 0;
+};
+
+// <name, accessOffsetInVar, thread> -> affinity_counts
+typedef std::map<std::tuple<std::string, uint64_t, uint64_t>, affinity_counts>
+    mapped_access_affinity;
+
+// Reads the "name addr size" lines written by the globals pass, sorted by
+// address
+std::vector<global_var> read_global_vars(std::istream &in);
+
+// Reads the "addr1 addr2 count" lines of an interferences file. Sampled runs
+// start with a "# sample <on> <off>" line and have counts scaled up by
+// (on + off) / on, which is returned through scale.
+std::vector<interference_count> read_interferences(std::istream &in,
+                                                   double &scale);
+
+// Reads the "addr thread R|W" lines of a *.threads file
+std::vector<thread_access> read_thread_accesses(std::istream &in);
+
+// Reads a *.lines file written by detect, with the cache line size of its
+// "# cacheline <size>" header returned through cacheline_size
+std::vector<line_sharing> read_line_sharing(std::istream &in,
+                                            uint64_t &cacheline_size);
+
+// Reads a *.affinity file written by detect, with the cache line size of its
+// "# cacheline <size>" header returned through cacheline_size
+std::vector<access_affinity> read_access_affinity(std::istream &in,
+                                                  uint64_t &cacheline_size);
+
+// <name, accessOffsetInVar, accessSize>, or an empty name if addr is not in
+// any of the sorted global_vars
+memory_access addr_to_named_access(uint64_t addr,
+                                   const std::vector<global_var> &global_vars);
+
+// Maps the interferences realized in the cache simulator and those found
+// potentially by detect to pairs of global variables, merging duplicates.
+// Interferences that do not fall in globals are dropped. Each conflict gets
+// the true sharing fraction of its line in lines, if given.
+std::vector<conflicting_access>
+map_conflicts(const std::vector<global_var> &global_vars,
+              const std::vector<interference_count> &realized,
+              double realized_scale,
+              const std::vector<interference_count> &potential,
+              double potential_scale,
+              const std::vector<line_sharing> &lines = {},
+              uint64_t cacheline_size = 0);
+
+mapped_thread_accesses
+map_thread_accesses(const std::vector<global_var> &global_vars,
+                    const std::vector<thread_access> &accesses);
+
+// Maps the accesses on each line to offsets in global variables, adding up
+// the counts of threads that reach the same offset at different addresses.
+// Accesses that do not fall in globals are dropped.
+mapped_access_affinity
+map_access_affinity(const std::vector<global_var> &global_vars,
+                    const std::vector<access_affinity> &accesses);
+
+// Writes mapped_conflicts.out lines. If the counts were sampled, each line
+// ends with the relative standard error of its priority.
+void write_conflicts(std::ostream &out,
+                     const std::vector<conflicting_access> &conflicts,
+                     bool sampled);
+
+// Writes mapped_threads.out lines
+void write_thread_accesses(std::ostream &out,
+                           const mapped_thread_accesses &accesses);
+
+// Writes mapped_lines.out lines, "false|true|mixed false_count true_count
+// name...", with the globals on each shared line. Lines without globals are
+// skipped.
+void write_line_sharing(std::ostream &out,
+                        const std::vector<line_sharing> &lines,
+                        const std::vector<global_var> &global_vars,
+                        uint64_t cacheline_size);
+
+// Writes mapped_affinity.out lines, "name offset size thread reads writes",
+// sorted by name, offset and thread
+void write_access_affinity(std::ostream &out,
+                           const mapped_access_affinity &affinity);
@@ -0,0 +1,55 @@
+#pragma once
+
+// Binary false sharing profile, written by MapAddr and analyze and read by
+// the fix pass. Integers are little-endian and every section starts at a
+// multiple of 8 bytes.
+//
+//   header (40 bytes; 32 in version 1, which has no run_length):
+//     char magic[8]             "FS583PRF"
+//     u32  version
+//     u32  flags                profile_flag_*
+//     u32  num_strings
+//     u32  num_conflicts
+//     u32  num_thread_accesses
+//     u32  string_data_size     in bytes, before padding
+//     u64  run_length           memory accesses in the profiled run that
+//                               priorities are relative to, 0 if unknown
+//   string entries, num_strings x 8 bytes:
+//     u32  offset               into the string data
+//     u32  length
+//   string data, padded with zeros to a multiple of 8 bytes
+//   conflicts, num_conflicts x 64 bytes (56 before version 3, without
+//   true_sharing):
+//     u32  name1, name2         string indices
+//     u64  offset1, size1, offset2, size2
+//     u64  priority
+//     f64  relative_error       0 unless the profile is sampled
+//     f64  true_sharing         fraction of the sharing on the conflict's
+//                               cache line that is true sharing, 0 if unknown
+//   thread accesses, num_thread_accesses x 40 bytes (24 before version 4,
+//   without reads and writes):
+//     u32  name                 string index
+//     u32  is_write
+//     u64  offset
+//     u64  thread
+//     u64  reads, writes        by the thread at the offset, 0 if unknown
+//
+// Readers must reject versions they do not know; new data goes in new
+// versions.
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr char profile_magic[8] = {'F', 'S', '5', '8', '3', 'P', 'R', 'F'};
+constexpr uint32_t profile_version = 4;
+
+// Priorities are estimates from a sampled run
+constexpr uint32_t profile_flag_sampled = 1;
+
+constexpr size_t profile_header_size = 40;
+constexpr size_t profile_v1_header_size = 32;
+constexpr size_t profile_string_entry_size = 8;
+constexpr size_t profile_conflict_size = 64;
+constexpr size_t profile_v2_conflict_size = 56;
+constexpr size_t profile_thread_access_size = 40;
+constexpr size_t profile_v3_thread_access_size = 24;
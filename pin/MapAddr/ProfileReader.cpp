@@ -0,0 +1,140 @@
+#include "ProfileReader.h"
+#include "ProfileFormat.h"
+
+#include <cstring>
+#include <iterator>
+#include <tuple>
+
+namespace {
+
+uint64_t get_le(const char *data, int bytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < bytes; i++) {
+    value |= static_cast<uint64_t>(static_cast<unsigned char>(data[i]))
+             << (8 * i);
+  }
+  return value;
+}
+
+uint32_t get_u32(const char *data) { return get_le(data, 4); }
+uint64_t get_u64(const char *data) { return get_le(data, 8); }
+
+double get_f64(const char *data) {
+  uint64_t bits = get_u64(data);
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+} // namespace
+
+bool read_binary_profile(std::istream &in, binary_profile &profile,
+                         std::string &error) {
+  const std::string data((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  if (data.size() < profile_v1_header_size ||
+      data.compare(0, sizeof(profile_magic), profile_magic,
+                   sizeof(profile_magic)) != 0) {
+    error = "not a binary profile";
+    return false;
+  }
+  const char *header = data.data();
+  const uint32_t version = get_u32(header + 8);
+  if (version < 1 || version > profile_version) {
+    error = "unsupported version " + std::to_string(version);
+    return false;
+  }
+  const uint64_t header_size =
+      version == 1 ? profile_v1_header_size : profile_header_size;
+  if (data.size() < header_size) {
+    error = "truncated header";
+    return false;
+  }
+  profile.sampled = get_u32(header + 12) & profile_flag_sampled;
+  const uint64_t num_strings = get_u32(header + 16);
+  const uint64_t num_conflicts = get_u32(header + 20);
+  const uint64_t num_thread_accesses = get_u32(header + 24);
+  const uint64_t string_data_size = get_u32(header + 28);
+  profile.run_length = version == 1 ? 0 : get_u64(header + 32);
+
+  const uint64_t string_entries_offset = header_size;
+  const uint64_t string_data_offset =
+      string_entries_offset + num_strings * profile_string_entry_size;
+  const uint64_t conflict_size =
+      version < 3 ? profile_v2_conflict_size : profile_conflict_size;
+  const uint64_t conflicts_offset =
+      string_data_offset + (string_data_size + 7) / 8 * 8;
+  const uint64_t thread_access_size = version < 4
+                                          ? profile_v3_thread_access_size
+                                          : profile_thread_access_size;
+  const uint64_t thread_accesses_offset =
+      conflicts_offset + num_conflicts * conflict_size;
+  const uint64_t end_offset =
+      thread_accesses_offset + num_thread_accesses * thread_access_size;
+  if (data.size() < end_offset) {
+    error = "truncated data";
+    return false;
+  }
+
+  std::vector<std::string> strings;
+  for (uint64_t i = 0; i < num_strings; i++) {
+    const char *entry =
+        header + string_entries_offset + i * profile_string_entry_size;
+    const uint64_t offset = get_u32(entry);
+    const uint64_t length = get_u32(entry + 4);
+    if (offset + length > string_data_size) {
+      error = "string out of bounds";
+      return false;
+    }
+    strings.push_back(data.substr(string_data_offset + offset, length));
+  }
+  auto get_string = [&](const char *field, std::string &str) {
+    const uint32_t index = get_u32(field);
+    if (index >= strings.size()) {
+      error = "string index out of bounds";
+      return false;
+    }
+    str = strings[index];
+    return true;
+  };
+
+  for (uint64_t i = 0; i < num_conflicts; i++) {
+    const char *record = header + conflicts_offset + i * conflict_size;
+    conflicting_access ca;
+    if (!get_string(record, ca.var1.name) ||
+        !get_string(record + 4, ca.var2.name)) {
+      return false;
+    }
+    ca.var1.accessOffset = get_u64(record + 8);
+    ca.var1.accessSize = get_u64(record + 16);
+    ca.var2.accessOffset = get_u64(record + 24);
+    ca.var2.accessSize = get_u64(record + 32);
+    ca.priority = get_u64(record + 40);
+    // The relative error is 1/sqrt(samples)
+    const double relative_error = get_f64(record + 48);
+    ca.samples = relative_error > 0 ? 1.0 / (relative_error * relative_error)
+                                    : static_cast<double>(ca.priority);
+    ca.true_sharing = version < 3 ? 0.0 : get_f64(record + 56);
+    profile.conflicts.push_back(ca);
+  }
+
+  for (uint64_t i = 0; i < num_thread_accesses; i++) {
+    const char *record =
+        header + thread_accesses_offset + i * thread_access_size;
+    std::string name;
+    if (!get_string(record, name)) {
+      return false;
+    }
+    const auto key = std::make_tuple(name, get_u64(record + 8),
+                                     get_u64(record + 16));
+    profile.thread_accesses[key] |= get_u32(record + 4) != 0;
+    const uint64_t reads = version < 4 ? 0 : get_u64(record + 24);
+    const uint64_t writes = version < 4 ? 0 : get_u64(record + 32);
+    if (reads > 0 || writes > 0) {
+      auto &counts = profile.access_affinity[key];
+      counts.reads += reads;
+      counts.writes += writes;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "ConflictMapper.h"
+
+#include <istream>
+#include <string>
+#include <vector>
+
+struct binary_profile {
+  std::vector<conflicting_access> conflicts;
+  mapped_thread_accesses thread_accesses;
+  // Read and write counts of the thread accesses that have them; the sizes
+  // of the accesses are not recorded
+  mapped_access_affinity access_affinity;
+  bool sampled = false;
+  uint64_t run_length = 0; // 0 if unknown
+};
+
+// Reads a profile in the binary format described in ProfileFormat.h. Sampled
+// conflicts get their number of samples back from their relative error.
+// Returns false and describes the problem in error if the profile is
+// malformed.
+bool read_binary_profile(std::istream &in, binary_profile &profile,
+                         std::string &error);
@@ -0,0 +1,112 @@
+#include "ProfileWriter.h"
+#include "ProfileFormat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+class ProfileBuffer {
+public:
+  void put_u32(uint32_t value) { put_le(value, 4); }
+  void put_u64(uint64_t value) { put_le(value, 8); }
+  void put_f64(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put_u64(bits);
+  }
+  void put_bytes(const std::string &bytes) { data += bytes; }
+  void pad_to(size_t alignment) {
+    data.resize((data.size() + alignment - 1) / alignment * alignment, '\0');
+  }
+  const std::string &str() const { return data; }
+
+private:
+  std::string data;
+
+  void put_le(uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+      data.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+  }
+};
+
+// Assigns each distinct string an index in the string table
+class StringTable {
+public:
+  uint32_t intern(const std::string &str) {
+    auto it = indices.emplace(str, strings.size());
+    if (it.second) {
+      strings.push_back(str);
+    }
+    return it.first->second;
+  }
+  const std::vector<std::string> &all() const { return strings; }
+
+private:
+  std::unordered_map<std::string, uint32_t> indices;
+  std::vector<std::string> strings;
+};
+
+} // namespace
+
+void write_binary_profile(std::ostream &out,
+                          const std::vector<conflicting_access> &conflicts,
+                          bool sampled,
+                          const mapped_thread_accesses &thread_accesses,
+                          const mapped_access_affinity &affinity,
+                          uint64_t run_length) {
+  StringTable strings;
+  ProfileBuffer conflict_data;
+  for (auto &ca : conflicts) {
+    conflict_data.put_u32(strings.intern(ca.var1.name));
+    conflict_data.put_u32(strings.intern(ca.var2.name));
+    conflict_data.put_u64(ca.var1.accessOffset);
+    conflict_data.put_u64(ca.var1.accessSize);
+    conflict_data.put_u64(ca.var2.accessOffset);
+    conflict_data.put_u64(ca.var2.accessSize);
+    conflict_data.put_u64(ca.priority);
+    conflict_data.put_f64(sampled ? 1.0 / std::sqrt(std::max(ca.samples, 1.0))
+                                  : 0.0);
+    conflict_data.put_f64(ca.true_sharing);
+  }
+
+  ProfileBuffer thread_data;
+  for (auto &ta : thread_accesses) {
+    thread_data.put_u32(strings.intern(std::get<0>(ta.first)));
+    thread_data.put_u32(ta.second ? 1 : 0);
+    thread_data.put_u64(std::get<1>(ta.first));
+    thread_data.put_u64(std::get<2>(ta.first));
+    auto counts = affinity.find(ta.first);
+    thread_data.put_u64(counts != affinity.end() ? counts->second.reads : 0);
+    thread_data.put_u64(counts != affinity.end() ? counts->second.writes : 0);
+  }
+
+  ProfileBuffer string_entries;
+  ProfileBuffer string_data;
+  for (auto &str : strings.all()) {
+    string_entries.put_u32(string_data.str().size());
+    string_entries.put_u32(str.size());
+    string_data.put_bytes(str);
+  }
+  const size_t string_data_size = string_data.str().size();
+  string_data.pad_to(8);
+
+  ProfileBuffer header;
+  header.put_bytes(std::string(profile_magic, sizeof(profile_magic)));
+  header.put_u32(profile_version);
+  header.put_u32(sampled ? profile_flag_sampled : 0);
+  header.put_u32(strings.all().size());
+  header.put_u32(conflicts.size());
+  header.put_u32(thread_accesses.size());
+  header.put_u32(string_data_size);
+  header.put_u64(run_length);
+
+  for (auto *section :
+       {&header, &string_entries, &string_data, &conflict_data, &thread_data}) {
+    out.write(section->str().data(), section->str().size());
+  }
+}
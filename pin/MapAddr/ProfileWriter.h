@@ -0,0 +1,17 @@
+#pragma once
+
+#include "ConflictMapper.h"
+
+#include <ostream>
+#include <vector>
+
+// Writes conflicts and thread accesses in the binary profile format described
+// in ProfileFormat.h, with the read and write counts of each thread access
+// taken from affinity. out must be opened in binary mode. run_length is the
+// number of memory accesses in the profiled run, or 0 if unknown.
+void write_binary_profile(std::ostream &out,
+                          const std::vector<conflicting_access> &conflicts,
+                          bool sampled,
+                          const mapped_thread_accesses &thread_accesses,
+                          const mapped_access_affinity &affinity,
+                          uint64_t run_length);
@@ -0,0 +1,248 @@
+// Measures how accurately the pipeline finds false sharing, by comparing the
+// conflicts in mapped_conflicts.out files against ground truth annotations.
+//
+// A ground truth file has one annotation per line:
+//   false <name1> <offset1> <name2> <offset2>   falsely shared pair
+//   true  <name1> <offset1> <name2> <offset2>   truly shared pair
+//   none  <name1> <offset1> <name2> <offset2>   pair that shares nothing
+// where an offset of * matches any offset in the variable and the order of the
+// two variables does not matter. Lines starting with # are comments.
+//
+// A conflict reported in mapped_conflicts.out is a true positive if it matches
+// a "false" annotation and a false positive otherwise; "true" and "none"
+// annotations only say why a reported conflict is wrong. A "false" annotation
+// that no reported conflict matches is a false negative. Precision and recall
+// are computed over all the pairs of files given.
+
+#include "../detect/InterferenceDetector.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const uint64_t ANY_OFFSET = UINT64_MAX;
+
+struct annotation {
+  std::string kind;
+  std::string name1;
+  uint64_t offset1;
+  std::string name2;
+  uint64_t offset2;
+};
+
+struct reported_conflict {
+  std::string name1;
+  uint64_t offset1;
+  std::string name2;
+  uint64_t offset2;
+};
+
+struct counts {
+  uint64_t true_positives = 0;
+  uint64_t false_positives = 0;
+  uint64_t false_negatives = 0;
+};
+
+bool read_annotations(const std::string &path,
+                      std::vector<annotation> &annotations) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Could not open ground truth: " << path << std::endl;
+    return false;
+  }
+  std::string line;
+  uint64_t linenum = 0;
+  while (std::getline(in, line)) {
+    ++linenum;
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream iss(line);
+    annotation a;
+    std::string offset1, offset2;
+    if (!(iss >> a.kind >> a.name1 >> offset1 >> a.name2 >> offset2) ||
+        (a.kind != "false" && a.kind != "true" && a.kind != "none")) {
+      std::cerr << path << ":" << linenum << ": invalid annotation: " << line
+                << std::endl;
+      return false;
+    }
+    try {
+      a.offset1 = offset1 == "*" ? ANY_OFFSET : string_to_uint64(offset1);
+      a.offset2 = offset2 == "*" ? ANY_OFFSET : string_to_uint64(offset2);
+    } catch (std::runtime_error &e) {
+      std::cerr << path << ":" << linenum << ": " << e.what() << std::endl;
+      return false;
+    }
+    annotations.push_back(a);
+  }
+  return true;
+}
+
+// Reads the distinct variable pairs of mapped_conflicts.out, ignoring sizes
+// and priorities. A pair may be listed more than once, in either order, for
+// different pairs of addresses or threads.
+bool read_conflicts(const std::string &path,
+                    std::vector<reported_conflict> &conflicts) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Could not open conflicts: " << path << std::endl;
+    return false;
+  }
+  std::set<std::tuple<std::string, uint64_t, std::string, uint64_t>> seen;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream iss(line);
+    reported_conflict c;
+    uint64_t size1, size2;
+    if (!(iss >> c.name1 >> c.offset1 >> size1 >> c.name2 >> c.offset2 >>
+          size2)) {
+      continue;
+    }
+    if (std::tie(c.name2, c.offset2) < std::tie(c.name1, c.offset1)) {
+      std::swap(c.name1, c.name2);
+      std::swap(c.offset1, c.offset2);
+    }
+    if (seen.insert({c.name1, c.offset1, c.name2, c.offset2}).second) {
+      conflicts.push_back(c);
+    }
+  }
+  return true;
+}
+
+bool offset_matches(uint64_t annotated, uint64_t reported) {
+  return annotated == ANY_OFFSET || annotated == reported;
+}
+
+bool matches(const annotation &a, const reported_conflict &c) {
+  return (a.name1 == c.name1 && offset_matches(a.offset1, c.offset1) &&
+          a.name2 == c.name2 && offset_matches(a.offset2, c.offset2)) ||
+         (a.name1 == c.name2 && offset_matches(a.offset1, c.offset2) &&
+          a.name2 == c.name1 && offset_matches(a.offset2, c.offset1));
+}
+
+std::string describe(const std::string &name1, uint64_t offset1,
+                     const std::string &name2, uint64_t offset2) {
+  auto offset = [](uint64_t o) {
+    return o == ANY_OFFSET ? std::string("*") : std::to_string(o);
+  };
+  return name1 + " " + offset(offset1) + " " + name2 + " " + offset(offset2);
+}
+
+counts check(const std::string &truth_path, const std::string &conflicts_path,
+             const std::vector<annotation> &annotations,
+             const std::vector<reported_conflict> &conflicts) {
+  counts result;
+  for (const auto &c : conflicts) {
+    const annotation *match = nullptr;
+    for (const auto &a : annotations) {
+      if (matches(a, c) && (!match || a.kind == "false")) {
+        match = &a;
+      }
+    }
+    if (match && match->kind == "false") {
+      ++result.true_positives;
+      continue;
+    }
+    ++result.false_positives;
+    std::cout << "  unexpected conflict: "
+              << describe(c.name1, c.offset1, c.name2, c.offset2);
+    if (match) {
+      std::cout << " (annotated " << (match->kind == "true" ? "true sharing"
+                                                            : "no sharing")
+                << ")";
+    }
+    std::cout << std::endl;
+  }
+  for (const auto &a : annotations) {
+    if (a.kind != "false") {
+      continue;
+    }
+    bool found = false;
+    for (const auto &c : conflicts) {
+      found = found || matches(a, c);
+    }
+    if (!found) {
+      ++result.false_negatives;
+      std::cout << "  missed false sharing: "
+                << describe(a.name1, a.offset1, a.name2, a.offset2)
+                << std::endl;
+    }
+  }
+  std::cout << conflicts_path << " against " << truth_path << ": "
+            << result.true_positives << " true positives, "
+            << result.false_positives << " false positives, "
+            << result.false_negatives << " false negatives" << std::endl;
+  return result;
+}
+
+// Ratio defined as 1 when there is nothing to measure
+double ratio(uint64_t numerator, uint64_t denominator) {
+  return denominator ? static_cast<double>(numerator) / denominator : 1.0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  double min_precision = 0;
+  double min_recall = 0;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "-min-precision" && i + 1 < argc) {
+      min_precision = std::stod(argv[++i]);
+    } else if (arg == "-min-recall" && i + 1 < argc) {
+      min_recall = std::stod(argv[++i]);
+    } else {
+      paths.push_back(arg);
+    }
+  }
+  if (paths.empty() || paths.size() % 2) {
+    std::cerr << "Usage: " << argv[0]
+              << " [-min-precision P] [-min-recall R] [ground truth] "
+                 "[mapped_conflicts.out]..."
+              << std::endl;
+    exit(1);
+  }
+
+  counts total;
+  for (size_t i = 0; i < paths.size(); i += 2) {
+    std::vector<annotation> annotations;
+    std::vector<reported_conflict> conflicts;
+    if (!read_annotations(paths[i], annotations) ||
+        !read_conflicts(paths[i + 1], conflicts)) {
+      exit(1);
+    }
+    counts c = check(paths[i], paths[i + 1], annotations, conflicts);
+    total.true_positives += c.true_positives;
+    total.false_positives += c.false_positives;
+    total.false_negatives += c.false_negatives;
+  }
+
+  const double precision =
+      ratio(total.true_positives, total.true_positives + total.false_positives);
+  const double recall =
+      ratio(total.true_positives, total.true_positives + total.false_negatives);
+  std::cout << "precision " << precision << ", recall " << recall << " ("
+            << total.true_positives << " true positives, "
+            << total.false_positives << " false positives, "
+            << total.false_negatives << " false negatives)" << std::endl;
+
+  if (precision < min_precision || recall < min_recall) {
+    std::cerr << "Accuracy below the minimum precision " << min_precision
+              << " or recall " << min_recall << std::endl;
+    return 1;
+  }
+  return 0;
+}
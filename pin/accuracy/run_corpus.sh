@@ -0,0 +1,36 @@
+#!/bin/bash
+# Runs analyze on every synthetic trace in corpus/ and checks the conflicts it
+# maps against the trace's ground truth (<name>.truth) with accuracy. All
+# traces share corpus/fs_globals.txt and have no mdcache interferences, so
+# only the detector and the mapping are measured.
+#
+# Usage: ./run_corpus.sh [accuracy options]
+#   e.g. ./run_corpus.sh -min-precision 0.9
+# By default every annotated conflict must be found, and nothing else.
+set -Eeuo pipefail
+
+ACCURACY_DIR="$(cd -- "$(dirname -- "${BASH_SOURCE[0]}")" && pwd)"
+CORPUS=${ACCURACY_DIR}/corpus
+CACHELINESIZE=64
+
+ACCURACY_ARGS=("$@")
+if [ ${#ACCURACY_ARGS[@]} -eq 0 ]; then
+    ACCURACY_ARGS=(-min-precision 1 -min-recall 1)
+fi
+
+make -s -C "${ACCURACY_DIR}" accuracy
+make -s -C "${ACCURACY_DIR}/../analyze" analyze
+
+RUN_DIR=$(mktemp -d)
+trap 'rm -rf "${RUN_DIR}"' EXIT
+
+PAIRS=()
+for trace in "${CORPUS}"/*.trace; do
+    name=$(basename "${trace}" .trace)
+    mkdir -p "${RUN_DIR}/${name}"
+    (cd "${RUN_DIR}/${name}" &&
+        "${ACCURACY_DIR}/../analyze/analyze" "${trace}" /dev/null "${CORPUS}/fs_globals.txt" ${CACHELINESIZE} > analyze.log)
+    PAIRS+=("${CORPUS}/${name}.truth" "${RUN_DIR}/${name}/mapped_conflicts.out")
+done
+
+"${ACCURACY_DIR}/accuracy" "${ACCURACY_ARGS[@]}" "${PAIRS[@]}"
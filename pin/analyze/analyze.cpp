@@ -0,0 +1,105 @@
+// Runs the analysis stage of the pipeline in one process: detects potential
+// interferences in pinatrace.out (or a binary trace, see detect/TraceFormat.h),
+// merges them with the interferences realized in mdcache, and maps both to
+// global variables. Intermediate results stay in memory; only the final
+// profile is written:
+//   mapped_conflicts.out  {name1 offset1 size1 name2 offset2 size2 priority [relerr]}
+//   mapped_threads.out    {name offset thread R|W}
+//   mapped_lines.out      {false|true|mixed false_count true_count name...}
+//   mapped_affinity.out   {name offset size thread reads writes}
+//   mapped_profile.fsp    both of the above in the binary format of
+//                         MapAddr/ProfileFormat.h, read by the fix pass
+// This replaces running detect and then MapAddr on detect's output files.
+
+#include "../MapAddr/AccessInfo.h"
+#include "../MapAddr/ConflictMapper.h"
+#include "../MapAddr/ProfileWriter.h"
+#include "../detect/InterferenceDetector.h"
+#include "../detect/TraceReader.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+  if (argc != 5) {
+    std::cerr << "Usage: " << argv[0]
+              << " [path to pinatrace.out] [path to "
+                 "mdcache.out.cacheline64.interferences] [path to "
+                 "fs_globals.txt] [cache line size in bytes]"
+              << std::endl;
+    exit(1);
+  }
+
+  uint64_t cacheline_size;
+  try {
+    cacheline_size = string_to_uint64(argv[4]);
+  } catch (std::runtime_error &e) {
+    std::cerr << e.what() << std::endl;
+    exit(1);
+  }
+
+  std::ifstream pinatrace(argv[1], std::ios::binary);
+  std::ifstream realized_conflicting_addrs(argv[2]);
+  std::ifstream global_addresses(argv[3]);
+  if (!pinatrace || !realized_conflicting_addrs || !global_addresses) {
+    std::cerr << "Could not open input files" << std::endl;
+    exit(1);
+  }
+
+  std::vector<global_var> global_vars = read_global_vars(global_addresses);
+  if (global_vars.empty()) {
+    std::cerr << "No global variables in " << argv[3] << std::endl;
+    exit(1);
+  }
+
+  std::cout << "Reading pinatrace file: " << argv[1]
+            << ", with cache line size: " << cacheline_size << std::endl;
+  InterferenceDetector detector(cacheline_size);
+  read_trace(pinatrace, detector);
+
+  double realized_scale;
+  auto realized_counts =
+      read_interferences(realized_conflicting_addrs, realized_scale);
+  const double potential_scale = detector.sampleScale();
+  bool sampled = realized_scale > 1.0 || potential_scale > 1.0;
+
+  const auto lines = detector.getLineSharing();
+  auto conflicts =
+      map_conflicts(global_vars, realized_counts, realized_scale,
+                    detector.getInterferences(), potential_scale, lines,
+                    cacheline_size);
+  std::ofstream out("mapped_conflicts.out");
+  write_conflicts(out, conflicts, sampled);
+  std::cout << "Outputted " << conflicts.size()
+            << " conflicts to file: mapped_conflicts.out" << std::endl;
+
+  auto thread_accesses =
+      map_thread_accesses(global_vars, detector.getThreadAccesses());
+  std::ofstream threads_out("mapped_threads.out");
+  write_thread_accesses(threads_out, thread_accesses);
+  std::cout << "Outputted per-thread accesses to file: mapped_threads.out"
+            << std::endl;
+
+  std::ofstream lines_out("mapped_lines.out");
+  write_line_sharing(lines_out, lines, global_vars, cacheline_size);
+  std::cout << "Outputted per-line sharing to file: mapped_lines.out"
+            << std::endl;
+
+  auto affinity =
+      map_access_affinity(global_vars, detector.getAccessAffinity());
+  std::ofstream affinity_out("mapped_affinity.out");
+  write_access_affinity(affinity_out, affinity);
+  std::cout << "Outputted per-thread access affinity to file: "
+               "mapped_affinity.out"
+            << std::endl;
+
+  std::ofstream profile_out("mapped_profile.fsp", std::ios::binary);
+  write_binary_profile(profile_out, conflicts, sampled, thread_accesses,
+                       affinity, detector.accessCount());
+  std::cout << "Outputted binary profile to file: mapped_profile.fsp"
+            << std::endl;
+}
@@ -1,5 +1,6 @@
 #include "InterferenceDetector.h"
 
+#include <algorithm>
 #include <iostream>
 #include <cassert>
 
@@ -35,58 +36,181 @@ void InterferenceDetector::recordAccess(const std::string &rw,
                                         const std::string &destAddr,
                                         const std::string &accessSize,
                                         const std::string &threadId) {
-  bool isWrite = string_to_rw(rw);
-  uint64_t destAddrNum = string_to_uint64(destAddr, HEX_BASE);
-  uint64_t accessSizeNum = string_to_uint64(accessSize);
-  uint64_t threadIdNum = string_to_uint64(threadId);
+  recordAccess(string_to_rw(rw), string_to_uint64(destAddr, HEX_BASE),
+               string_to_uint64(accessSize), string_to_uint64(threadId));
+}
 
+void InterferenceDetector::recordAccess(bool isWrite, uint64_t destAddrNum,
+                                        uint64_t accessSizeNum,
+                                        uint64_t threadIdNum) {
+  ++num_accesses;
   uint64_t cacheline_index = destAddrNum / cacheline_size;
   CacheLine &cacheline = cachelines[cacheline_index];
-  cacheline.accesses[threadIdNum];
+  auto access_it = cacheline.accesses[threadIdNum].emplace(
+      destAddrNum, CacheLine::Access{isWrite, accessSizeNum});
+  CacheLine::Access &recorded = access_it.first->second;
+  ++(isWrite ? recorded.writes : recorded.reads);
+  if (!access_it.second) {
+    // Mark as write if it wasn't before. TODO: Might react to this.
+    recorded.isWrite = recorded.isWrite || isWrite;
+    // Access already recorded, and compared with the other threads' accesses
+    if (recorded.accessSize >= accessSizeNum) {
+      return;
+    }
+    recorded.accessSize = accessSizeNum;
+  }
+  // std::cout << std::hex << "Recorded access to " << destAddrNum << " of
+  // size " << accessSizeNum
+  //           << " for thread " << threadIdNum << " in cacheline " <<
+  //           cacheline_index << std::endl;
+
+  // Compare with every other thread's accesses to the line, which does not
+  // depend on the order the threads are stored in.
   for (auto &threadAccesses : cacheline.accesses) {
     if (threadAccesses.first == threadIdNum) {
-      auto access_it = threadAccesses.second.emplace(
-          destAddrNum, CacheLine::Access{isWrite, accessSizeNum});
-      if (!access_it.second) {
-        // Mark as write if it wasn't before. TODO: Might react to this.
-        access_it.first->second.isWrite =
-            (access_it.first->second.isWrite) || isWrite;
-        // Access already recorded
-        if (access_it.first->second.accessSize >= accessSizeNum) {
-          return;
-        } else {
-          access_it.first->second.accessSize = accessSizeNum;
-        }
-      }
-      // std::cout << std::hex << "Recorded access to " << destAddrNum << " of
-      // size " << accessSizeNum
-      //           << " for thread " << threadIdNum << " in cacheline " <<
-      //           cacheline_index << std::endl;
       continue;
     }
     for (const auto &access : threadAccesses.second) {
-      // If the access ranges overlap, it is not false sharing
+      if (!isWrite && !access.second.isWrite) {
+        continue; // don't mark as interference is both accesses are reads
+      }
+      // If the access ranges overlap, it is true sharing, not false sharing
       if ((access.first >= destAddrNum &&
            access.first < destAddrNum + accessSizeNum) ||
           (destAddrNum >= access.first &&
            destAddrNum < access.first + access.second.accessSize)) {
+        ++cacheline.trueSharing;
         continue;
       }
-      if (!isWrite && !access.second.isWrite) {
-        continue; // don't mark as interference is both accesses are reads
-      }
       // assert(access.first != destAddrNum);
       conflicting_addr interference{access.first, destAddrNum};
       interferences[interference]++;
+      ++cacheline.falseSharing;
+      hotLines.insert(cacheline_index);
+    }
+  }
+}
+
+void InterferenceDetector::setSampling(uint64_t sample_on_in,
+                                       uint64_t sample_off_in) {
+  sample_on = sample_on_in;
+  sample_off = sample_off_in;
+}
+
+double InterferenceDetector::sampleScale() const {
+  if (sample_on > 0 && sample_off > 0) {
+    return static_cast<double>(sample_on + sample_off) / sample_on;
+  }
+  return 1.0;
+}
+
+uint64_t InterferenceDetector::accessCount() const {
+  return static_cast<uint64_t>(num_accesses * sampleScale() + 0.5);
+}
+
+std::vector<interference_count> InterferenceDetector::getInterferences() const {
+  const double scale = sampleScale();
+  std::vector<interference_count> counts;
+  counts.reserve(interferences.size());
+  for (const auto &interference : interferences) {
+    counts.push_back({interference.first.addr1, interference.first.addr2,
+                      static_cast<uint64_t>(interference.second * scale + 0.5)});
+  }
+  return counts;
+}
+
+std::vector<thread_access> InterferenceDetector::getThreadAccesses() const {
+  std::vector<thread_access> result;
+  for (uint64_t cacheline_index : hotLines) {
+    const CacheLine &cacheline = cachelines.at(cacheline_index);
+    for (const auto &threadAccesses : cacheline.accesses) {
+      for (const auto &access : threadAccesses.second) {
+        result.push_back(
+            {access.first, threadAccesses.first, access.second.isWrite});
+      }
     }
   }
+  return result;
+}
+
+std::vector<line_sharing> InterferenceDetector::getLineSharing() const {
+  const double scale = sampleScale();
+  std::vector<line_sharing> lines;
+  for (const auto &cacheline : cachelines) {
+    if (cacheline.second.falseSharing == 0 &&
+        cacheline.second.trueSharing == 0) {
+      continue;
+    }
+    lines.push_back(
+        {cacheline.first * cacheline_size,
+         static_cast<uint64_t>(cacheline.second.falseSharing * scale + 0.5),
+         static_cast<uint64_t>(cacheline.second.trueSharing * scale + 0.5)});
+  }
+  std::sort(lines.begin(), lines.end(),
+            [](const line_sharing &left, const line_sharing &right) {
+              return left.line_addr < right.line_addr;
+            });
+  return lines;
+}
+
+std::vector<access_affinity> InterferenceDetector::getAccessAffinity() const {
+  const double scale = sampleScale();
+  std::vector<access_affinity> result;
+  for (uint64_t cacheline_index : hotLines) {
+    const uint64_t line_addr = cacheline_index * cacheline_size;
+    const CacheLine &cacheline = cachelines.at(cacheline_index);
+    for (const auto &threadAccesses : cacheline.accesses) {
+      for (const auto &access : threadAccesses.second) {
+        result.push_back(
+            {line_addr, threadAccesses.first, access.first - line_addr,
+             access.second.accessSize,
+             static_cast<uint64_t>(access.second.reads * scale + 0.5),
+             static_cast<uint64_t>(access.second.writes * scale + 0.5)});
+      }
+    }
+  }
+  std::sort(result.begin(), result.end(),
+            [](const access_affinity &left, const access_affinity &right) {
+              return std::tie(left.line_addr, left.thread, left.offset) <
+                     std::tie(right.line_addr, right.thread, right.offset);
+            });
+  return result;
 }
 
 void InterferenceDetector::outputInterferences(std::ostream &out) {
   std::cout << "Number of interferences: " << interferences.size() << std::endl;
-  for (const auto &interference : interferences) {
-    out << std::hex << interference.first.addr1 
-        << "\t" << interference.first.addr2 
-        << "\t" << std::dec << interference.second << std::endl;
+  if (sample_on > 0 && sample_off > 0) {
+    out << "# sample " << sample_on << " " << sample_off << std::endl;
+  }
+  for (const auto &interference : getInterferences()) {
+    out << std::hex << interference.addr1 
+        << "\t" << interference.addr2 
+        << "\t" << std::dec << interference.count
+        << std::endl;
+  }
+}
+
+void InterferenceDetector::outputThreadAccesses(std::ostream &out) {
+  for (const auto &access : getThreadAccesses()) {
+    out << std::hex << access.addr << "\t" << std::dec << access.thread << "\t"
+        << (access.isWrite ? "W" : "R") << std::endl;
+  }
+}
+
+void InterferenceDetector::outputLineSharing(std::ostream &out) {
+  out << "# cacheline " << cacheline_size << std::endl;
+  for (const auto &line : getLineSharing()) {
+    out << std::hex << line.line_addr << "\t" << std::dec << line.false_count
+        << "\t" << line.true_count << "\t"
+        << sharing_kind_name(classify(line)) << std::endl;
+  }
+}
+
+void InterferenceDetector::outputAccessAffinity(std::ostream &out) {
+  out << "# cacheline " << cacheline_size << std::endl;
+  for (const auto &access : getAccessAffinity()) {
+    out << std::hex << access.line_addr << "\t" << std::dec << access.thread
+        << "\t" << access.offset << "\t" << access.size << "\t"
+        << access.reads << "\t" << access.writes << std::endl;
   }
 }
@@ -8,6 +8,7 @@
 #include <string>
 #include <tuple>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 uint64_t string_to_uint64(const std::string &str, int base = 10);
@@ -18,22 +19,80 @@ public:
 
   void recordAccess(const std::string &rw, const std::string &destAddr,
                     const std::string &accessSize, const std::string &threadId);
+  void recordAccess(bool isWrite, uint64_t destAddr, uint64_t accessSize,
+                    uint64_t threadId);
+
+  // Records that the accesses are a burst sample of the full run: sample_on
+  // accesses recorded out of every sample_on + sample_off. Interference counts
+  // are scaled back up on output.
+  void setSampling(uint64_t sample_on, uint64_t sample_off);
+
+  // Factor by which interference counts are scaled to estimate the full run
+  double sampleScale() const;
+
+  // Number of accesses recorded, scaled up to estimate the full run
+  uint64_t accessCount() const;
+
+  // Interferences between pairs of addresses, with sampled counts scaled up
+  std::vector<interference_count> getInterferences() const;
+
+  // Every access to a line that saw at least one interference
+  std::vector<thread_access> getThreadAccesses() const;
+
+  // Sharing on every line that two threads shared, with sampled counts scaled
+  // up, sorted by address
+  std::vector<line_sharing> getLineSharing() const;
+
+  // Reads and writes by each thread to each address of a line that saw at
+  // least one interference, with sampled counts scaled up, sorted by line,
+  // thread and offset
+  std::vector<access_affinity> getAccessAffinity() const;
 
   void outputInterferences(std::ostream &out);
 
+  // Output every address accessed on a line that saw at least one
+  // interference, as "addr<tab>thread<tab>R|W", so later stages can tell
+  // which threads touch each conflicting variable.
+  void outputThreadAccesses(std::ostream &out);
+
+  // Output the sharing on each shared line, after a "# cacheline <size>"
+  // header, as "line_addr<tab>false<tab>true<tab>false|true|mixed" with the
+  // number of falsely and truly shared access pairs, so lines whose traffic
+  // padding cannot remove can be told apart.
+  void outputLineSharing(std::ostream &out);
+
+  // Output which bytes of each line that saw at least one interference each
+  // thread reads and writes, after a "# cacheline <size>" header, as
+  // "line_addr<tab>thread<tab>offset<tab>size<tab>reads<tab>writes", so a
+  // layout can group the fields one thread uses and separate those of
+  // different threads.
+  void outputAccessAffinity(std::ostream &out);
+
 private:
   uint64_t cacheline_size;
+  uint64_t sample_on = 0;
+  uint64_t sample_off = 0;
+  uint64_t num_accesses = 0;
 
   struct CacheLine {
     struct Access {
       bool isWrite;
       uint64_t accessSize;
+      uint64_t reads = 0;
+      uint64_t writes = 0;
     };
     // thread id -> destAddr -> Access
     std::unordered_map<uint64_t, std::unordered_map<uint64_t, Access>> accesses;
+    // Pairs of accesses by different threads, at least one a write, to
+    // disjoint and to overlapping bytes of the line
+    uint64_t falseSharing = 0;
+    uint64_t trueSharing = 0;
   };
   std::unordered_map<uint64_t, CacheLine> cachelines;
 
+  // Indices of cache lines with at least one interference
+  std::unordered_set<uint64_t> hotLines;
+
   // interference -> count
   std::unordered_map<conflicting_addr, uint64_t> interferences;
 };
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+// Binary memory access trace, read by detect, analyze and throughput in place
+// of pinatrace.out text. Integers are little-endian.
+//
+//   header (24 bytes):
+//     char magic[8]             "FS583TRC"
+//     u32  version
+//     u32  flags                0
+//     u32  sample_on            as in "# sample <on> <off>", 0 if unsampled
+//     u32  sample_off
+//   records until the end of the file, 16 bytes each:
+//     u64  addr
+//     u32  size
+//     u16  thread
+//     u16  is_write
+//
+// Readers must reject versions they do not know; new data goes in new
+// versions.
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr char trace_magic[8] = {'F', 'S', '5', '8', '3', 'T', 'R', 'C'};
+constexpr uint32_t trace_version = 1;
+
+constexpr size_t trace_header_size = 24;
+
+struct trace_record {
+  uint64_t addr;
+  uint32_t size;
+  uint16_t thread;
+  uint16_t is_write;
+};
+static_assert(sizeof(trace_record) == 16, "trace records are 16 bytes");
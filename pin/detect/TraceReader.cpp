@@ -0,0 +1,148 @@
+#include "TraceReader.h"
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void read_pinatrace(std::istream &in, InterferenceDetector &detector) {
+    std::string line;
+
+    // Columns of the pinatrace file:
+    // program counter, read or write, dest addr, size of access, thread id, value
+    std::string pc, rw, dest, sz, tid, val;
+
+    uint64_t linenum = 0;
+    while (std::getline(in, line)) {
+        std::istringstream iss(line);
+
+        bool parseError = !(iss >> pc >> rw >> dest >> sz >> tid >> val);
+        ++linenum;
+        if (line.rfind("# sample ", 0) == 0) {
+            // "# sample <on> <off>" header written by sampled pinatrace runs
+            uint64_t sample_on, sample_off;
+            std::istringstream header(line.substr(9));
+            if (header >> sample_on >> sample_off) {
+                detector.setSampling(sample_on, sample_off);
+            } else {
+                std::cout << "Line #" << (linenum - 1) << " has an invalid sampling header" << std::endl;
+            }
+            continue;
+        }
+        if (!pc.empty() && pc[0] == '#') 
+            continue; // filter out comments
+        if (parseError) {
+            std::cout << "Line #" << (linenum - 1) << " formatted incorrectly:" << std::endl;
+            std::cout << '\t' << pc << '\t' << rw << '\t' << dest << '\t' << sz << '\t' << tid << '\t' << val << std::endl;
+            continue;
+        }
+        
+        try {
+            detector.recordAccess(rw, dest, sz, tid);
+        } catch (std::runtime_error& e) {
+            std::cout << "Error processing line #" << (linenum - 1) << ": " << e.what() << std::endl;
+            continue; // ignore bad access
+        }
+
+        if (linenum % 100000 == 0) {
+            std::cout << "Processed " << linenum << " lines" << std::endl;
+        }
+    }
+}
+
+namespace {
+
+uint64_t get_le(const char *data, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+} // namespace
+
+bool is_binary_trace(std::istream &in) {
+    char magic[sizeof(trace_magic)];
+    const std::streampos start = in.tellg();
+    const bool matches = in.read(magic, sizeof(magic)) &&
+                         std::memcmp(magic, trace_magic, sizeof(magic)) == 0;
+    in.clear();
+    in.seekg(start);
+    return matches;
+}
+
+bool read_binary_trace_header(std::istream &in, uint32_t &sample_on,
+                              uint32_t &sample_off, std::string &error) {
+    char header[trace_header_size];
+    if (!in.read(header, sizeof(header)) ||
+        std::memcmp(header, trace_magic, sizeof(trace_magic)) != 0) {
+        error = "not a binary trace";
+        return false;
+    }
+    const uint32_t version = get_le(header + 8, 4);
+    if (version != trace_version) {
+        error = "unsupported version " + std::to_string(version);
+        return false;
+    }
+    sample_on = get_le(header + 16, 4);
+    sample_off = get_le(header + 20, 4);
+    return true;
+}
+
+size_t read_binary_trace_records(std::istream &in, trace_record *records,
+                                 size_t max_records) {
+    // Decoded from a chunk of raw bytes, to stay independent of the host's
+    // byte order
+    static thread_local std::vector<char> buffer;
+    buffer.resize(max_records * sizeof(trace_record));
+    in.read(buffer.data(), buffer.size());
+    const size_t count = in.gcount() / sizeof(trace_record);
+    for (size_t i = 0; i < count; i++) {
+        const char *data = buffer.data() + i * sizeof(trace_record);
+        records[i].addr = get_le(data, 8);
+        records[i].size = get_le(data + 8, 4);
+        records[i].thread = get_le(data + 12, 2);
+        records[i].is_write = get_le(data + 14, 2);
+    }
+    if (in.gcount() % sizeof(trace_record)) {
+        std::cout << "Binary trace ends with a truncated record" << std::endl;
+    }
+    return count;
+}
+
+void read_binary_trace(std::istream &in, InterferenceDetector &detector) {
+    uint32_t sample_on, sample_off;
+    std::string error;
+    if (!read_binary_trace_header(in, sample_on, sample_off, error)) {
+        std::cout << "Could not read binary trace: " << error << std::endl;
+        return;
+    }
+    if (sample_on || sample_off) {
+        detector.setSampling(sample_on, sample_off);
+    }
+
+    const size_t chunk = 4096;
+    std::vector<trace_record> records(chunk);
+    uint64_t processed = 0;
+    while (size_t count = read_binary_trace_records(in, records.data(), chunk)) {
+        for (size_t i = 0; i < count; i++) {
+            detector.recordAccess(records[i].is_write, records[i].addr,
+                                  records[i].size, records[i].thread);
+        }
+        processed += count;
+        if (processed % (100 * chunk) == 0) {
+            std::cout << "Processed " << processed << " records" << std::endl;
+        }
+    }
+}
+
+void read_trace(std::istream &in, InterferenceDetector &detector) {
+    if (is_binary_trace(in)) {
+        read_binary_trace(in, detector);
+    } else {
+        read_pinatrace(in, detector);
+    }
+}
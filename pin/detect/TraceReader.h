@@ -0,0 +1,36 @@
+#pragma once
+
+#include "InterferenceDetector.h"
+#include "TraceFormat.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+
+// Records every access of a pinatrace.out trace in detector. Comment lines are
+// skipped, and a "# sample <on> <off>" header sets the detector's sampling.
+// Malformed lines are reported to std::cout and ignored.
+void read_pinatrace(std::istream &in, InterferenceDetector &detector);
+
+// Whether in starts with the magic of a binary trace (TraceFormat.h). Does not
+// consume any input.
+bool is_binary_trace(std::istream &in);
+
+// Reads the header of a binary trace. Returns false and describes the problem
+// in error if it is not a binary trace this reader knows.
+bool read_binary_trace_header(std::istream &in, uint32_t &sample_on,
+                              uint32_t &sample_off, std::string &error);
+
+// Reads up to max_records records of a binary trace whose header has been
+// read. Returns the number of records read, 0 at the end of the trace.
+size_t read_binary_trace_records(std::istream &in, trace_record *records,
+                                 size_t max_records);
+
+// Records every access of a binary trace in detector, with the sampling of its
+// header. A malformed header or a truncated last record is reported to
+// std::cout.
+void read_binary_trace(std::istream &in, InterferenceDetector &detector);
+
+// Reads a trace in either format
+void read_trace(std::istream &in, InterferenceDetector &detector);
@@ -1,5 +1,8 @@
-// Takes in pinatrace.out
+// Takes in pinatrace.out, or a binary trace (TraceFormat.h)
 // Output list of interferences {addr1, addr2, [priority]}
+// and the threads accessing each address on an interfering line {addr, thread, R|W}
+// and the false and true sharing on each shared line {line addr, false, true, kind}
+// and the reads and writes of each thread on an interfering line {line addr, thread, offset, size, reads, writes}
 
 #include <iostream>
 #include <fstream>
@@ -8,6 +11,7 @@
 #include <cstdint>
 
 #include "InterferenceDetector.h"
+#include "TraceReader.h"
 
 void process_pinatrace(const std::string& pinatrace_file, uint64_t cacheline_size);
 
@@ -38,7 +42,7 @@ int main(int argc, char **argv) {
 }
 
 void process_pinatrace(const std::string& pinatrace_file, uint64_t cacheline_size) {
-    std::ifstream infile(pinatrace_file);
+    std::ifstream infile(pinatrace_file, std::ios::binary);
     std::string output_file = pinatrace_file + ".cacheline" + std::to_string(cacheline_size) + ".interferences";
     std::ofstream outfile(output_file);
     if (!outfile.is_open()) {
@@ -46,41 +50,37 @@ void process_pinatrace(const std::string& pinatrace_file, uint64_t cacheline_siz
         exit(1);
     }
 
-    std::string line;
-
-    // Columns of the pinatrace file:
-    // program counter, read or write, dest addr, size of access, thread id, value
-    std::string pc, rw, dest, sz, tid, val;
-
     InterferenceDetector detector(cacheline_size);
+    read_trace(infile, detector);
 
-    uint64_t linenum = 0;
-    while (std::getline(infile, line)) {
-        std::istringstream iss(line);
+    detector.outputInterferences(outfile);
+    std::cout << "Outputted interferences to file: " << output_file << std::endl;
 
-        bool parseError = !(iss >> pc >> rw >> dest >> sz >> tid >> val);
-        ++linenum;
-        if (!pc.empty() && pc[0] == '#') 
-            continue; // filter out comments
-        if (parseError) {
-            std::cout << "Line #" << (linenum - 1) << " formatted incorrectly:" << std::endl;
-            std::cout << '\t' << pc << '\t' << rw << '\t' << dest << '\t' << sz << '\t' << tid << '\t' << val << std::endl;
-            continue;
-        }
-        
-        try {
-            detector.recordAccess(rw, dest, sz, tid);
-        } catch (std::runtime_error& e) {
-            std::cout << "Error processing line #" << (linenum - 1) << ": " << e.what() << std::endl;
-            continue; // ignore bad access
-        }
+    std::string threads_file = pinatrace_file + ".cacheline" + std::to_string(cacheline_size) + ".threads";
+    std::ofstream threadsout(threads_file);
+    if (!threadsout.is_open()) {
+        std::cout << "Could not open output file: " << threads_file << std::endl;
+        exit(1);
+    }
+    detector.outputThreadAccesses(threadsout);
+    std::cout << "Outputted per-thread accesses to file: " << threads_file << std::endl;
 
-        if (linenum % 100000 == 0) {
-            std::cout << "Processed " << linenum << " lines" << std::endl;
-        }
+    std::string lines_file = pinatrace_file + ".cacheline" + std::to_string(cacheline_size) + ".lines";
+    std::ofstream linesout(lines_file);
+    if (!linesout.is_open()) {
+        std::cout << "Could not open output file: " << lines_file << std::endl;
+        exit(1);
     }
+    detector.outputLineSharing(linesout);
+    std::cout << "Outputted per-line sharing to file: " << lines_file << std::endl;
 
-    detector.outputInterferences(outfile);
-    std::cout << "Outputted interferences to file: " << output_file << std::endl;
+    std::string affinity_file = pinatrace_file + ".cacheline" + std::to_string(cacheline_size) + ".affinity";
+    std::ofstream affinityout(affinity_file);
+    if (!affinityout.is_open()) {
+        std::cout << "Could not open output file: " << affinity_file << std::endl;
+        exit(1);
+    }
+    detector.outputAccessAffinity(affinityout);
+    std::cout << "Outputted per-thread access affinity to file: " << affinity_file << std::endl;
 }
 
@@ -10,13 +10,17 @@
 
 #include "pin.H"
 
+#include <cstddef>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <vector>
 
 #include "mdcache.H"
 #include "mutex.PH"
 #include "pin_profile.H"
+#include "modules.PH"
+#include "sampling.PH"
 using std::cerr;
 using std::endl;
 using std::ostringstream;
@@ -63,6 +67,13 @@ KNOB<UINT32> KnobLineSize(KNOB_MODE_WRITEONCE, "pintool", "b", "64",
                           "cache block size in bytes");
 KNOB<UINT32> KnobAssociativity(KNOB_MODE_WRITEONCE, "pintool", "a", "4",
                                "cache associativity (1 for direct mapped)");
+KNOB<UINT32> KnobNumPagesInBuffer(KNOB_MODE_WRITEONCE, "pintool", "num_pages",
+                                  "1",
+                                  "number of pages in each thread's buffer");
+KNOB<BOOL> KnobVerifyBatch(
+    KNOB_MODE_WRITEONCE, "pintool", "verify_batch", "0",
+    "also simulate each access separately in shadow caches and check that "
+    "batching does not change the statistics -- increases profiling time");
 KNOB<string> KnobInterferenceOutputFile(
     KNOB_MODE_WRITEONCE, "pintool", "i",
     std::string("mdcache.out.cacheline") + "XX" + ".interferences",
@@ -97,17 +108,31 @@ std::map<UINT32, DL1::CACHE *> caches;
 shared_mutex cachelist_mu;
 mutex invalidation_mutex;
 
+// With -verify_batch, caches simulated one access at a time, and a lock
+// keeping both sets of caches fed in the same order
+std::map<UINT32, DL1::CACHE *> shadowCaches;
+mutex shadow_invalidation_mutex;
+mutex verify_mu;
+
 // You must have unique access to cachelist_mu
-void insert_cache_for(UINT32 thread) {
+void add_cache(std::map<UINT32, DL1::CACHE *> &cacheList, UINT32 thread,
+               mutex &write_mu) {
   DL1::CACHE *cache = new DL1::CACHE(
       "L1 Data Cache for Core " + sstr(thread), KnobCacheSize.Value() * KILO,
-      KnobLineSize.Value(), KnobAssociativity.Value(), invalidation_mutex);
+      KnobLineSize.Value(), KnobAssociativity.Value(), write_mu);
   std::map<UINT32, DL1::CACHE *>::iterator it;
-  for (it = caches.begin(); it != caches.end(); it++) {
+  for (it = cacheList.begin(); it != cacheList.end(); it++) {
     it->second->RegisterPeer(cache);
     cache->RegisterPeer(it->second);
   }
-  caches[thread] = cache;
+  cacheList[thread] = cache;
+}
+
+// You must have unique access to cachelist_mu
+void insert_cache_for(UINT32 thread) {
+  add_cache(caches, thread, invalidation_mutex);
+  if (KnobVerifyBatch)
+    add_cache(shadowCaches, thread, shadow_invalidation_mutex);
 }
 
 // You may not have possession of cachelist_mu
@@ -135,212 +160,132 @@ COMPRESSOR_COUNTER<ADDRINT, UINT32, COUNTER_HIT_MISS> profile;
 
 /* ===================================================================== */
 
-VOID LoadMulti(ADDRINT addr, UINT32 size, UINT32 instId, UINT32 threadID) {
-  // first level D-cache
-  ensure_cache_exists(threadID);
-  DL1::CACHE *cache;
-  {
-    shared_lock lock(cachelist_mu);
-    cache = caches.find(threadID)->second;
-  }
-
-  const BOOL cacheHit = cache->Access(addr, size, CACHE_BASE::ACCESS_TYPE_LOAD);
-
-  const COUNTER counter = cacheHit ? COUNTER_HIT : COUNTER_MISS;
-  profile[instId][counter]++;
-}
-
-/* ===================================================================== */
-
-VOID StoreMulti(ADDRINT addr, UINT32 size, UINT32 instId, UINT32 threadID) {
-  // first level D-cache
-  ensure_cache_exists(threadID);
-  DL1::CACHE *cache;
-  {
-    shared_lock lock(cachelist_mu);
-    cache = caches.find(threadID)->second;
-  }
-
-  const BOOL cacheHit =
-      cache->Access(addr, size, CACHE_BASE::ACCESS_TYPE_STORE);
-
-  const COUNTER counter = cacheHit ? COUNTER_HIT : COUNTER_MISS;
-  profile[instId][counter]++;
-}
+BUFFER_ID bufId;
 
-/* ===================================================================== */
-
-VOID LoadSingle(ADDRINT addr, UINT32 instId, UINT32 threadID) {
-  // @todo we may access several cache lines for
-  // first level D-cache
-  ensure_cache_exists(threadID);
-  DL1::CACHE *cache;
-  {
-    shared_lock lock(cachelist_mu);
-    cache = caches.find(threadID)->second;
-  }
-
-  const BOOL cacheHit =
-      cache->AccessSingleLine(addr, CACHE_BASE::ACCESS_TYPE_LOAD);
-
-  const COUNTER counter = cacheHit ? COUNTER_HIT : COUNTER_MISS;
-  profile[instId][counter]++;
-}
-/* ===================================================================== */
-
-VOID StoreSingle(ADDRINT addr, UINT32 instId, UINT32 threadID) {
-  // @todo we may access several cache lines for
-  // first level D-cache
-  ensure_cache_exists(threadID);
-  DL1::CACHE *cache;
-  {
-    shared_lock lock(cachelist_mu);
-    cache = caches.find(threadID)->second;
+VOID SimulateBatch(DL1::CACHE *cache, const CACHE_RECORD *records,
+                   UINT64 numElements) {
+  if (!KnobTrackLoads && !KnobTrackStores) {
+    cache->AccessBatch(records, numElements);
+    return;
   }
 
-  const BOOL cacheHit =
-      cache->AccessSingleLine(addr, CACHE_BASE::ACCESS_TYPE_STORE);
-
-  const COUNTER counter = cacheHit ? COUNTER_HIT : COUNTER_MISS;
-  profile[instId][counter]++;
-}
-
-/* ===================================================================== */
-
-VOID LoadMultiFast(ADDRINT addr, UINT32 size, UINT32 threadID) {
-  ensure_cache_exists(threadID);
-  DL1::CACHE *cache;
-  {
-    shared_lock lock(cachelist_mu);
-    cache = caches.find(threadID)->second;
+  static thread_local std::vector<UINT8> hits;
+  hits.resize(numElements);
+  cache->AccessBatch(records, numElements, hits.data());
+
+  for (UINT64 i = 0; i < numElements; i++) {
+    const BOOL track = (records[i].accessType == CACHE_BASE::ACCESS_TYPE_LOAD)
+                           ? KnobTrackLoads.Value()
+                           : KnobTrackStores.Value();
+    if (track) {
+      const COUNTER counter = hits[i] ? COUNTER_HIT : COUNTER_MISS;
+      profile[records[i].instId][counter]++;
+    }
   }
-
-  cache->Access(addr, size, CACHE_BASE::ACCESS_TYPE_LOAD);
 }
 
-/* ===================================================================== */
-
-VOID StoreMultiFast(ADDRINT addr, UINT32 size, UINT32 threadID) {
-  ensure_cache_exists(threadID);
+// Simulates a thread's buffered accesses in its first level D-cache. Records
+// from different threads are interleaved at buffer granularity, so the buffer
+// is kept small by default.
+VOID *BufferFull(BUFFER_ID id, THREADID tid, const CONTEXT *ctxt, VOID *buf,
+                 UINT64 numElements, VOID *v) {
+  ensure_cache_exists(tid);
   DL1::CACHE *cache;
+  DL1::CACHE *shadow = nullptr;
   {
     shared_lock lock(cachelist_mu);
-    cache = caches.find(threadID)->second;
+    cache = caches.find(tid)->second;
+    if (KnobVerifyBatch)
+      shadow = shadowCaches.find(tid)->second;
   }
 
-  cache->Access(addr, size, CACHE_BASE::ACCESS_TYPE_STORE);
-}
-
-/* ===================================================================== */
-
-VOID LoadSingleFast(ADDRINT addr, UINT32 threadID) {
-  ensure_cache_exists(threadID);
-  DL1::CACHE *cache;
-  {
-    shared_lock lock(cachelist_mu);
-    cache = caches.find(threadID)->second;
+  const CACHE_RECORD *records = static_cast<const CACHE_RECORD *>(buf);
+  if (shadow) {
+    lock_guard lock(verify_mu);
+    for (UINT64 i = 0; i < numElements; i++) {
+      shadow->AccessRecord(records[i]);
+    }
+    SimulateBatch(cache, records, numElements);
+  } else {
+    SimulateBatch(cache, records, numElements);
   }
-
-  cache->AccessSingleLine(addr, CACHE_BASE::ACCESS_TYPE_LOAD);
+  return buf;
 }
 
 /* ===================================================================== */
 
-VOID StoreSingleFast(ADDRINT addr, UINT32 threadID) {
-  ensure_cache_exists(threadID);
-    DL1::CACHE *cache;
-  {
-    shared_lock lock(cachelist_mu);
-    cache = caches.find(threadID)->second;
+// Fills a record for one memory operand of ins, only for sampled accesses in
+// the region of interest
+VOID InsertRecord(INS ins, UINT32 memOp, UINT32 instId,
+                  CACHE_BASE::ACCESS_TYPE accessType) {
+  const UINT32 size = INS_MemoryOperandSize(ins, memOp);
+  if (InsertAnalysisGuard(ins)) {
+    INS_InsertFillBufferThen(
+        ins, IPOINT_BEFORE, bufId, IARG_MEMORYOP_EA, memOp,
+        offsetof(CACHE_RECORD, addr), IARG_UINT32, size,
+        offsetof(CACHE_RECORD, size), IARG_UINT32, instId,
+        offsetof(CACHE_RECORD, instId), IARG_UINT32, accessType,
+        offsetof(CACHE_RECORD, accessType), IARG_END);
+  } else {
+    INS_InsertFillBufferPredicated(
+        ins, IPOINT_BEFORE, bufId, IARG_MEMORYOP_EA, memOp,
+        offsetof(CACHE_RECORD, addr), IARG_UINT32, size,
+        offsetof(CACHE_RECORD, size), IARG_UINT32, instId,
+        offsetof(CACHE_RECORD, instId), IARG_UINT32, accessType,
+        offsetof(CACHE_RECORD, accessType), IARG_END);
   }
-
-
-  cache->AccessSingleLine(addr, CACHE_BASE::ACCESS_TYPE_STORE);
 }
 
-/* ===================================================================== */
-
-VOID Instruction(INS ins, void *v) {
-  if (!INS_IsStandardMemop(ins))
-    return;
-
-  if (INS_MemoryOperandCount(ins) == 0)
-    return;
-
-  UINT32 readSize = 0, writeSize = 0;
-  UINT32 readOperandCount = 0, writeOperandCount = 0;
-
-  for (UINT32 opIdx = 0; opIdx < INS_MemoryOperandCount(ins); opIdx++) {
-    if (INS_MemoryOperandIsRead(ins, opIdx)) {
-      readSize = INS_MemoryOperandSize(ins, opIdx);
-      readOperandCount++;
-      break;
-    }
-    if (INS_MemoryOperandIsWritten(ins, opIdx)) {
-      writeSize = INS_MemoryOperandSize(ins, opIdx);
-      writeOperandCount++;
-      break;
-    }
-  }
-
-  if (readOperandCount > 0) {
-    // map sparse INS addresses to dense IDs
-    const ADDRINT iaddr = INS_Address(ins);
-    const UINT32 instId = profile.Map(iaddr);
-
-    const BOOL single = (readSize <= 4);
-
-    if (KnobTrackLoads) {
-      if (single) {
-        INS_InsertPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR)LoadSingle,
-                                 IARG_MEMORYREAD_EA, IARG_UINT32, instId,
-                                 IARG_THREAD_ID, IARG_END);
-      } else {
-        INS_InsertPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR)LoadMulti,
-                                 IARG_MEMORYREAD_EA, IARG_MEMORYREAD_SIZE,
-                                 IARG_UINT32, instId, IARG_THREAD_ID,
-                                   IARG_END);
-      }
-    } else {
-      if (single) {
-        INS_InsertPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR)LoadSingleFast,
-                                 IARG_MEMORYREAD_EA, IARG_THREAD_ID, IARG_END);
-      } else {
-        INS_InsertPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR)LoadMultiFast,
-                                 IARG_MEMORYREAD_EA, IARG_MEMORYREAD_SIZE,
-                                 IARG_THREAD_ID, IARG_END);
+VOID Trace(TRACE trace, void *v) {
+  for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+    for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
+      if (!INS_IsStandardMemop(ins))
+        continue;
+
+      if (INS_MemoryOperandCount(ins) == 0)
+        continue;
+
+      // map sparse INS addresses to dense IDs
+      UINT32 instId = 0;
+      if (KnobTrackLoads || KnobTrackStores)
+        instId = profile.Map(INS_Address(ins));
+
+      for (UINT32 memOp = 0; memOp < INS_MemoryOperandCount(ins); memOp++) {
+        if (INS_MemoryOperandIsRead(ins, memOp))
+          InsertRecord(ins, memOp, instId, CACHE_BASE::ACCESS_TYPE_LOAD);
+        if (INS_MemoryOperandIsWritten(ins, memOp))
+          InsertRecord(ins, memOp, instId, CACHE_BASE::ACCESS_TYPE_STORE);
       }
     }
   }
+}
 
-  if (writeOperandCount > 0) {
-    // map sparse INS addresses to dense IDs
-    const ADDRINT iaddr = INS_Address(ins);
-    const UINT32 instId = profile.Map(iaddr);
-    const BOOL single = (writeSize <= 4);
-
-    if (KnobTrackStores) {
-      if (single) {
-        INS_InsertPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR)StoreSingle,
-                                 IARG_MEMORYWRITE_EA, IARG_UINT32, instId,
-                                 IARG_THREAD_ID, IARG_END);
-      } else {
-        INS_InsertPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR)StoreMulti,
-                                 IARG_MEMORYWRITE_EA, IARG_MEMORYWRITE_SIZE,
-                                 IARG_UINT32, instId, IARG_THREAD_ID,
-                                   IARG_END);
-      }
-    } else {
-      if (single) {
-        INS_InsertPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR)StoreSingleFast,
-                                 IARG_MEMORYWRITE_EA, IARG_THREAD_ID, IARG_END);
-      } else {
-        INS_InsertPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR)StoreMultiFast,
-                                 IARG_MEMORYWRITE_EA, IARG_MEMORYWRITE_SIZE,
-                                 IARG_THREAD_ID, IARG_END);
+// Returns whether the batched and the shadow caches agree, reporting any
+// difference to out
+BOOL VerifyBatch(std::ostream &out) {
+  BOOL same = TRUE;
+  std::map<UINT32, DL1::CACHE *>::iterator it;
+  for (it = caches.begin(); it != caches.end(); it++) {
+    const DL1::CACHE *cache = it->second;
+    const DL1::CACHE *shadow = shadowCaches.find(it->first)->second;
+    for (UINT32 i = 0; i < CACHE_BASE::ACCESS_TYPE_NUM; i++) {
+      const CACHE_BASE::ACCESS_TYPE accessType =
+          static_cast<CACHE_BASE::ACCESS_TYPE>(i);
+      if (cache->Hits(accessType) != shadow->Hits(accessType) ||
+          cache->Misses(accessType) != shadow->Misses(accessType) ||
+          cache->Tombstones(accessType) != shadow->Tombstones(accessType)) {
+        out << "# verify_batch: core " << it->first
+            << " statistics differ for access type " << i << endl;
+        same = FALSE;
       }
     }
+    if (cache->InterferenceCounts() != shadow->InterferenceCounts()) {
+      out << "# verify_batch: core " << it->first << " interferences differ"
+          << endl;
+      same = FALSE;
+    }
   }
+  return same;
 }
 
 /* ===================================================================== */
@@ -367,12 +312,28 @@ VOID Instruction(INS ins, void *v) {
     std::map<Interference, unsigned>::iterator cit;
     // interferenceFile << "Number of interferences: " << counts.size()
     //                  << std::endl;
+    // Scale sampled counts back up to estimates for the full run
+    WriteModuleTable(interferenceFile);
+    WriteSampleHeader(interferenceFile);
+    const double scale = SampleScale();
     for (cit = counts.begin(); cit != counts.end(); cit++) {
-      interferenceFile << std::hex << cit->first.first << "\t"
-                       << cit->first.second << "\t" << std::dec << cit->second
+      interferenceFile << std::hex << NormalizeAddress(cit->first.first)
+                       << "\t" << NormalizeAddress(cit->first.second) << "\t"
+                       << std::dec
+                       << static_cast<UINT64>(cit->second * scale + 0.5)
                        << std::endl;
     }
 
+    if (KnobVerifyBatch) {
+      if (VerifyBatch(outFile)) {
+        outFile << "# verify_batch: batched statistics match\n";
+      } else {
+        cerr << "mdcache: batched statistics differ from per-access "
+                "statistics, see "
+             << KnobOutputFile.Value() << endl;
+      }
+    }
+
     if (KnobTrackLoads || KnobTrackStores) {
       outFile << "#\n"
                  "# LOAD stats\n"
@@ -394,6 +355,9 @@ VOID Instruction(INS ins, void *v) {
       if (PIN_Init(argc, argv)) {
         return Usage();
       }
+      InitSampling();
+      InitRoi();
+      InitModules();
 
       outFile.open(KnobOutputFile.Value().c_str());
       // Replace XX with the cachelinesize
@@ -411,7 +375,14 @@ VOID Instruction(INS ins, void *v) {
 
       profile.SetThreshold(threshold);
 
-      INS_AddInstrumentFunction(Instruction, 0);
+      bufId = PIN_DefineTraceBuffer(sizeof(CACHE_RECORD),
+                                    KnobNumPagesInBuffer, BufferFull, 0);
+      if (bufId == BUFFER_ID_INVALID) {
+        cerr << "Error: could not allocate initial buffer" << endl;
+        return 1;
+      }
+
+      TRACE_AddInstrumentFunction(Trace, 0);
       PIN_AddFiniFunction(Fini, 0);
 
       // Never returns
@@ -0,0 +1,159 @@
+// Merges binary profiles from several runs into one, so the fix pass can
+// optimize for the aggregate workload. Conflicts are keyed by variable names
+// and offsets, so the runs may have different address space layouts.
+//
+// Each input may be given a weight as path:weight (1 by default). When every
+// input records its run length, priorities are first normalized to the mean
+// run length, so that long runs do not dominate just by being long. Thread
+// accesses are combined, with their read and write counts scaled like
+// priorities; thread numbers are assumed to refer to the same threads in
+// every run. True sharing fractions are averaged, weighted by priority.
+
+#include "../MapAddr/AccessInfo.h"
+#include "../MapAddr/ConflictMapper.h"
+#include "../MapAddr/ProfileReader.h"
+#include "../MapAddr/ProfileWriter.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// <name1, offset1, size1, name2, offset2, size2>, with the lesser variable
+// first
+typedef std::tuple<std::string, uint64_t, uint64_t, std::string, uint64_t,
+                   uint64_t>
+    conflict_key;
+
+struct weighted_conflict {
+  conflicting_access access;
+  double priority = 0;
+  double true_sharing = 0; // sum of true sharing fractions times priority
+};
+
+conflict_key key_of(conflicting_access &ca) {
+  if (std::tie(ca.var2.name, ca.var2.accessOffset, ca.var2.accessSize) <
+      std::tie(ca.var1.name, ca.var1.accessOffset, ca.var1.accessSize)) {
+    std::swap(ca.var1, ca.var2);
+  }
+  return {ca.var1.name, ca.var1.accessOffset, ca.var1.accessSize,
+          ca.var2.name, ca.var2.accessOffset, ca.var2.accessSize};
+}
+
+// Splits "path:weight" into its parts; a path without a numeric suffix has
+// weight 1.
+std::pair<std::string, double> parse_input(const std::string &arg) {
+  auto colon = arg.rfind(':');
+  if (colon != std::string::npos) {
+    try {
+      size_t parsed;
+      double weight = std::stod(arg.substr(colon + 1), &parsed);
+      if (parsed == arg.size() - colon - 1) {
+        return {arg.substr(0, colon), weight};
+      }
+    } catch (...) {
+      // not a weight
+    }
+  }
+  return {arg, 1.0};
+}
+
+int main(int argc, char **argv) {
+  std::string output_file("mapped_profile.fsp");
+  std::vector<std::pair<std::string, double>> inputs;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "-o" && i + 1 < argc) {
+      output_file = argv[++i];
+    } else {
+      inputs.push_back(parse_input(arg));
+    }
+  }
+  if (inputs.empty()) {
+    std::cerr << "Usage: " << argv[0]
+              << " [-o output.fsp] [profile.fsp[:weight]]..." << std::endl;
+    exit(1);
+  }
+
+  std::vector<binary_profile> profiles(inputs.size());
+  bool lengths_known = true;
+  double total_length = 0;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    std::ifstream in(inputs[i].first, std::ios::binary);
+    std::string error;
+    if (!in) {
+      std::cerr << "Could not open profile: " << inputs[i].first << std::endl;
+      exit(1);
+    }
+    if (!read_binary_profile(in, profiles[i], error)) {
+      std::cerr << "Could not read profile " << inputs[i].first << ": "
+                << error << std::endl;
+      exit(1);
+    }
+    lengths_known = lengths_known && profiles[i].run_length > 0;
+    total_length += profiles[i].run_length;
+  }
+  const double reference_length = lengths_known ? total_length / inputs.size() : 0;
+  if (!lengths_known) {
+    std::cout << "Some profiles do not record their run length; priorities "
+                 "are not normalized"
+              << std::endl;
+  }
+
+  std::map<conflict_key, weighted_conflict> conflicts;
+  mapped_thread_accesses thread_accesses;
+  mapped_access_affinity access_affinity;
+  bool sampled = false;
+  for (size_t i = 0; i < profiles.size(); i++) {
+    double factor = inputs[i].second;
+    if (lengths_known) {
+      factor *= reference_length / profiles[i].run_length;
+    }
+    sampled = sampled || profiles[i].sampled;
+
+    for (auto &ca : profiles[i].conflicts) {
+      auto key = key_of(ca);
+      auto it = conflicts.find(key);
+      if (it == conflicts.end()) {
+        it = conflicts.emplace(key, weighted_conflict{ca, 0, 0}).first;
+        it->second.access.samples = 0;
+      }
+      it->second.priority += ca.priority * factor;
+      it->second.true_sharing += ca.true_sharing * ca.priority * factor;
+      it->second.access.samples += ca.samples;
+    }
+    for (auto &ta : profiles[i].thread_accesses) {
+      thread_accesses[ta.first] |= ta.second;
+    }
+    for (auto &aa : profiles[i].access_affinity) {
+      auto &counts = access_affinity[aa.first];
+      counts.reads += std::llround(aa.second.reads * factor);
+      counts.writes += std::llround(aa.second.writes * factor);
+    }
+  }
+
+  std::vector<conflicting_access> result;
+  for (auto &entry : conflicts) {
+    auto ca = entry.second.access;
+    ca.priority = static_cast<uint64_t>(std::llround(entry.second.priority));
+    // Weighted by priority, like the runs' contributions to it
+    ca.true_sharing = entry.second.priority > 0
+                          ? entry.second.true_sharing / entry.second.priority
+                          : 0;
+    if (ca.priority > 0) {
+      result.push_back(ca);
+    }
+  }
+
+  std::ofstream out(output_file, std::ios::binary);
+  write_binary_profile(out, result, sampled, thread_accesses, access_affinity,
+                       static_cast<uint64_t>(std::llround(reference_length)));
+  std::cout << "Merged " << inputs.size() << " profiles into " << result.size()
+            << " conflicts in " << output_file << std::endl;
+}
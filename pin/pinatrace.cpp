@@ -8,11 +8,15 @@
  */
 
 // #include "mutex.PH"
+#include <cstddef>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <pin.H>
 #include <sstream>
+
+#include "modules.PH"
+#include "sampling.PH"
 using std::cerr;
 using std::dec;
 using std::endl;
@@ -54,6 +58,9 @@ KNOB<string> KnobOutputFile(KNOB_MODE_WRITEONCE, "pintool", "o",
                             "pinatrace.out", "specify trace file name");
 KNOB<BOOL> KnobValues(KNOB_MODE_WRITEONCE, "pintool", "values", "1",
                       "Output memory values reads and written");
+KNOB<UINT32> KnobNumPagesInBuffer(KNOB_MODE_WRITEONCE, "pintool", "num_pages",
+                                  "256",
+                                  "number of pages in each thread's buffer");
 
 /* ===================================================================== */
 /* Print Help Message                                                    */
@@ -108,68 +115,83 @@ static VOID EmitMem(std::ostream &os, VOID *ea, INT32 size) {
   }
 }
 
-static VOID RecordMem(VOID *ip, CHAR r, VOID *addr, INT32 size, THREADID id,
-                      BOOL isPrefetch) {
-  lock_guard lock(tf_mu);
-  TraceFile << ip << ": " << r << " " << setw(2 + 2 * sizeof(ADDRINT)) << addr
+// One record per dynamic memory operand, filled in by inlined code and
+// written out in bulk by BufferFull
+struct MEMREF {
+  ADDRINT pc;
+  ADDRINT ea;
+  UINT32 size;
+  BOOL isWrite;
+  BOOL isPrefetch;
+};
+
+BUFFER_ID bufId;
+
+static VOID RecordMem(ADDRINT ip, CHAR r, ADDRINT addr, UINT32 size,
+                      THREADID id, BOOL isPrefetch) {
+  TraceFile << reinterpret_cast<VOID *>(NormalizeAddress(ip)) << ": " << r
+            << " " << setw(2 + 2 * sizeof(ADDRINT))
+            << reinterpret_cast<VOID *>(NormalizeAddress(addr))
             << " " << dec << setw(2) << size << " " << id << " " << hex
             << setw(2 + 2 * sizeof(ADDRINT));
-  if (!isPrefetch)
-    EmitMem(TraceFile, addr, size);
+  // Values are read when the buffer is processed rather than at the access,
+  // so they may be newer than the accessed value. detect does not use them.
+  UINT8 value[64];
+  if (!isPrefetch && size <= sizeof(value) &&
+      PIN_SafeCopy(value, reinterpret_cast<VOID *>(addr), size) == size)
+    EmitMem(TraceFile, value, size);
   TraceFile << endl;
   //   if (TraceString.str().length() > 68)
   //     cerr << TraceString.str().length() << " " << TraceString.str() << endl;
 }
 
-static VOID *WriteAddr;
-static INT32 WriteSize;
-
-static VOID RecordWriteAddrSize(VOID *addr, INT32 size) {
-  WriteAddr = addr;
-  WriteSize = size;
-}
-
-static THREADID ThreadId;
-static VOID RecordThreadID(THREADID id) { ThreadId = id; }
-
-static VOID RecordMemWrite(VOID *ip) {
-  RecordMem(ip, 'W', WriteAddr, WriteSize, ThreadId, false);
-}
-
-VOID Instruction(INS ins, VOID *v) {
-  // instruments loads using a predicated call, i.e.
-  // the call happens iff the load will be actually executed
-
-  if (INS_IsMemoryRead(ins) && INS_IsStandardMemop(ins)) {
-    INS_InsertPredicatedCall(
-        ins, IPOINT_BEFORE, (AFUNPTR)RecordMem, IARG_INST_PTR, IARG_UINT32, 'R',
-        IARG_MEMORYREAD_EA, IARG_MEMORYREAD_SIZE, IARG_THREAD_ID, IARG_BOOL,
-        INS_IsPrefetch(ins), IARG_END);
+static VOID *BufferFull(BUFFER_ID id, THREADID tid, const CONTEXT *ctxt,
+                        VOID *buf, UINT64 numElements, VOID *v) {
+  const MEMREF *refs = static_cast<const MEMREF *>(buf);
+  lock_guard lock(tf_mu);
+  for (UINT64 i = 0; i < numElements; i++) {
+    const MEMREF &ref = refs[i];
+    RecordMem(ref.pc, ref.isWrite ? 'W' : 'R', ref.ea, ref.size, tid,
+              ref.isPrefetch);
   }
+  return buf;
+}
 
-  if (INS_HasMemoryRead2(ins) && INS_IsStandardMemop(ins)) {
-    INS_InsertPredicatedCall(
-        ins, IPOINT_BEFORE, (AFUNPTR)RecordMem, IARG_INST_PTR, IARG_UINT32, 'R',
-        IARG_MEMORYREAD2_EA, IARG_MEMORYREAD_SIZE, IARG_THREAD_ID, IARG_BOOL,
-        INS_IsPrefetch(ins), IARG_END);
+// Fills a record for one memory operand of ins, only for sampled accesses in
+// the region of interest
+static VOID InsertRecord(INS ins, UINT32 memOp, BOOL isWrite) {
+  const UINT32 size = INS_MemoryOperandSize(ins, memOp);
+  const BOOL isPrefetch = INS_IsPrefetch(ins);
+  if (InsertAnalysisGuard(ins)) {
+    INS_InsertFillBufferThen(
+        ins, IPOINT_BEFORE, bufId, IARG_INST_PTR, offsetof(MEMREF, pc),
+        IARG_MEMORYOP_EA, memOp, offsetof(MEMREF, ea), IARG_UINT32, size,
+        offsetof(MEMREF, size), IARG_BOOL, isWrite, offsetof(MEMREF, isWrite),
+        IARG_BOOL, isPrefetch, offsetof(MEMREF, isPrefetch), IARG_END);
+  } else {
+    INS_InsertFillBufferPredicated(
+        ins, IPOINT_BEFORE, bufId, IARG_INST_PTR, offsetof(MEMREF, pc),
+        IARG_MEMORYOP_EA, memOp, offsetof(MEMREF, ea), IARG_UINT32, size,
+        offsetof(MEMREF, size), IARG_BOOL, isWrite, offsetof(MEMREF, isWrite),
+        IARG_BOOL, isPrefetch, offsetof(MEMREF, isPrefetch), IARG_END);
   }
+}
 
-  // instruments stores using a predicated call, i.e.
-  // the call happens iff the store will be actually executed
-  if (INS_IsMemoryWrite(ins) && INS_IsStandardMemop(ins)) {
-    INS_InsertPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR)RecordWriteAddrSize,
-                             IARG_MEMORYWRITE_EA, IARG_MEMORYWRITE_SIZE,
-                             IARG_END);
-    INS_InsertPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR)RecordThreadID,
-                             IARG_THREAD_ID, IARG_END);
-
-    if (INS_IsValidForIpointAfter(ins)) {
-      INS_InsertCall(ins, IPOINT_AFTER, (AFUNPTR)RecordMemWrite, IARG_INST_PTR,
-                     IARG_END);
-    }
-    if (INS_IsValidForIpointTakenBranch(ins)) {
-      INS_InsertCall(ins, IPOINT_TAKEN_BRANCH, (AFUNPTR)RecordMemWrite,
-                     IARG_INST_PTR, IARG_END);
+VOID Trace(TRACE trace, VOID *v) {
+  // Records are only filled if the instruction is actually executed, since
+  // the fill is predicated. Writes are recorded before the instruction, as
+  // their address and size are already known.
+  for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+    for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
+      if (!INS_IsStandardMemop(ins))
+        continue;
+
+      for (UINT32 memOp = 0; memOp < INS_MemoryOperandCount(ins); memOp++) {
+        if (INS_MemoryOperandIsRead(ins, memOp))
+          InsertRecord(ins, memOp, FALSE);
+        if (INS_MemoryOperandIsWritten(ins, memOp))
+          InsertRecord(ins, memOp, TRUE);
+      }
     }
   }
 }
@@ -178,6 +200,7 @@ VOID Instruction(INS ins, VOID *v) {
 
 VOID Fini(INT32 code, VOID *v) {
   lock_guard lock(tf_mu);
+  WriteModuleTable(TraceFile);
   TraceFile << "#eof" << endl;
 
   TraceFile.close();
@@ -192,28 +215,36 @@ int main(int argc, char *argv[]) {
                                "# Memory Access Trace Generated By Pin\n"
                                "#\n");
 
+  PIN_InitSymbols();
   if (PIN_Init(argc, argv)) {
     return Usage();
   }
+  InitSampling();
+  InitRoi();
+  InitModules();
 
   {
     lock_guard lock(tf_mu);
     TraceFile.open(KnobOutputFile.Value().c_str());
     TraceFile.write(trace_header.c_str(), trace_header.size());
+    WriteSampleHeader(TraceFile);
     TraceFile.setf(ios::showbase);
   }
 
-  INS_AddInstrumentFunction(Instruction, 0);
+  bufId = PIN_DefineTraceBuffer(sizeof(MEMREF), KnobNumPagesInBuffer,
+                                BufferFull, 0);
+  if (bufId == BUFFER_ID_INVALID) {
+    cerr << "Error: could not allocate initial buffer" << endl;
+    return 1;
+  }
+
+  TRACE_AddInstrumentFunction(Trace, 0);
   PIN_AddFiniFunction(Fini, 0);
 
   // Never returns
 
   PIN_StartProgram();
 
-  RecordMemWrite(0);
-  RecordWriteAddrSize(0, 0);
-  RecordThreadID(0);
-
   return 0;
 }
 
@@ -0,0 +1,31 @@
+#!/bin/bash
+# Reports the throughput of detect and of the cache model on synthetic traces
+# as CSV, one line per trace, model and format. Save the output to track
+# analysis throughput over time.
+#
+# Usage: ./run_throughput.sh [tracegen options]
+#   e.g. ./run_throughput.sh -threads 16 -working-set 1048576
+# The options apply to every trace; each trace uses its own offset
+# distribution (see tracegen.cpp).
+# Environment:
+#   RECORDS    accesses per trace (1000000)
+set -Eeuo pipefail
+
+THROUGHPUT_DIR="$(cd -- "$(dirname -- "${BASH_SOURCE[0]}")" && pwd)"
+RECORDS=${RECORDS:-1000000}
+
+make -s -C "${THROUGHPUT_DIR}" tracegen throughput
+
+TRACE_DIR=$(mktemp -d)
+trap 'rm -rf "${TRACE_DIR}"' EXIT
+
+echo "offsets,model,format,records,seconds,records_per_s,peak_rss_kb,interferences"
+for offsets in spread same random; do
+    for format in text binary; do
+        trace=${TRACE_DIR}/${offsets}.${format}
+        "${THROUGHPUT_DIR}/tracegen" -records "${RECORDS}" -offsets ${offsets} "$@" \
+            -format ${format} -o "${trace}" > /dev/null
+        echo "${offsets},$("${THROUGHPUT_DIR}/throughput" -model detect -csv "${trace}")"
+    done
+    echo "${offsets},$("${THROUGHPUT_DIR}/throughput" -model cache -csv "${TRACE_DIR}/${offsets}.binary")"
+done
@@ -0,0 +1,216 @@
+// Measures how fast the analysis tools process a trace: the records per
+// second and peak resident memory of detect's InterferenceDetector, or of the
+// cache model of mdcache.H fed the way mdcache feeds it. Run one model per
+// process, so the peak resident memory is that model's.
+//
+// detect reads pinatrace.out text or binary traces; the cache model reads
+// binary traces (detect/TraceFormat.h), like the buffers Pin hands to mdcache.
+// Traces can be generated with tracegen.
+
+// The stand-in for Pin must come first, as in mdcache.cpp
+#include "pin.H"
+
+#include "../detect/InterferenceDetector.h"
+#include "../detect/TraceFormat.h"
+#include "../detect/TraceReader.h"
+#include "../mdcache.H"
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Same configuration as mdcache.cpp
+namespace DL1 {
+const UINT32 max_sets = KILO;
+const UINT32 max_associativity = 256;
+const CACHE_ALLOC::STORE_ALLOCATION allocation = CACHE_ALLOC::STORE_ALLOCATE;
+
+typedef CACHE_ROUND_ROBIN(max_sets, max_associativity, allocation) CACHE;
+} // namespace DL1
+
+struct options {
+  std::string model = "detect";
+  uint64_t line_size = 64;
+  uint64_t cache_size_kb = 32;
+  uint64_t associativity = 4;
+  // Records per batch; mdcache's default buffer is one page
+  uint64_t batch = 4096 / sizeof(CACHE_RECORD);
+  bool csv = false;
+  std::string trace;
+};
+
+struct result {
+  uint64_t records = 0;
+  uint64_t interferences = 0;
+};
+
+void usage(const char *argv0) {
+  std::cerr << "Usage: " << argv0
+            << " [-model detect|cache] [-line-size N] [-cache-size KB] "
+               "[-associativity N] [-batch N] [-csv] [trace]"
+            << std::endl;
+  exit(1);
+}
+
+result run_detect(std::ifstream &in, uint64_t line_size) {
+  InterferenceDetector detector(line_size);
+  // Progress messages would be timed too
+  std::streambuf *cout_buf = std::cout.rdbuf(nullptr);
+  read_trace(in, detector);
+  std::cout.rdbuf(cout_buf);
+
+  result r;
+  // Records read, not the estimate for the full run of a sampled trace
+  r.records = static_cast<uint64_t>(
+      detector.accessCount() / detector.sampleScale() + 0.5);
+  r.interferences = detector.getInterferences().size();
+  return r;
+}
+
+// Simulates each run of consecutive records of a thread as one of mdcache's
+// buffers, in a per-thread cache that invalidates its peers on stores
+result run_cache(std::ifstream &in, const options &opts) {
+  uint32_t sample_on, sample_off;
+  std::string error;
+  if (!read_binary_trace_header(in, sample_on, sample_off, error)) {
+    std::cerr << "The cache model needs a binary trace: " << error
+              << std::endl;
+    exit(1);
+  }
+
+  mutex invalidation_mutex;
+  std::map<UINT32, DL1::CACHE *> caches;
+  auto cache_for = [&](UINT32 thread) {
+    auto it = caches.find(thread);
+    if (it != caches.end()) {
+      return it->second;
+    }
+    DL1::CACHE *cache = new DL1::CACHE(
+        "L1 Data Cache for Core " + std::to_string(thread),
+        opts.cache_size_kb * KILO, opts.line_size, opts.associativity,
+        invalidation_mutex);
+    for (auto &peer : caches) {
+      peer.second->RegisterPeer(cache);
+      cache->RegisterPeer(peer.second);
+    }
+    caches[thread] = cache;
+    return cache;
+  };
+
+  result r;
+  std::vector<trace_record> records(opts.batch);
+  std::vector<CACHE_RECORD> batch;
+  batch.reserve(opts.batch);
+  UINT32 batch_thread = 0;
+  auto flush = [&]() {
+    if (!batch.empty()) {
+      cache_for(batch_thread)->AccessBatch(batch.data(), batch.size());
+      batch.clear();
+    }
+  };
+  while (size_t count =
+             read_binary_trace_records(in, records.data(), records.size())) {
+    for (size_t i = 0; i < count; i++) {
+      const trace_record &record = records[i];
+      if (record.thread != batch_thread || batch.size() == opts.batch) {
+        flush();
+        batch_thread = record.thread;
+      }
+      batch.push_back(CACHE_RECORD{
+          record.addr, record.size, 0,
+          record.is_write ? CACHE_BASE::ACCESS_TYPE_STORE
+                          : CACHE_BASE::ACCESS_TYPE_LOAD});
+    }
+    r.records += count;
+  }
+  flush();
+
+  std::map<Interference, unsigned> counts;
+  for (auto &cache : caches) {
+    AddAllMappings(cache.second->InterferenceCounts(), counts);
+    delete cache.second;
+  }
+  r.interferences = counts.size();
+  return r;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  options opts;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg(argv[i]);
+    if (arg == "-csv") {
+      opts.csv = true;
+    } else if (arg[0] == '-' && i + 1 < argc) {
+      const std::string value(argv[++i]);
+      try {
+        if (arg == "-model") {
+          opts.model = value;
+        } else if (arg == "-line-size") {
+          opts.line_size = string_to_uint64(value);
+        } else if (arg == "-cache-size") {
+          opts.cache_size_kb = string_to_uint64(value);
+        } else if (arg == "-associativity") {
+          opts.associativity = string_to_uint64(value);
+        } else if (arg == "-batch") {
+          opts.batch = string_to_uint64(value);
+        } else {
+          usage(argv[0]);
+        }
+      } catch (std::runtime_error &e) {
+        std::cerr << e.what() << std::endl;
+        exit(1);
+      }
+    } else if (opts.trace.empty()) {
+      opts.trace = arg;
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (opts.trace.empty() || (opts.model != "detect" && opts.model != "cache") ||
+      opts.batch == 0) {
+    usage(argv[0]);
+  }
+
+  std::ifstream in(opts.trace, std::ios::binary);
+  if (!in) {
+    std::cerr << "Could not open trace: " << opts.trace << std::endl;
+    exit(1);
+  }
+  const bool binary = is_binary_trace(in);
+
+  const auto start = std::chrono::steady_clock::now();
+  const result r = opts.model == "detect" ? run_detect(in, opts.line_size)
+                                          : run_cache(in, opts);
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  struct rusage resources;
+  getrusage(RUSAGE_SELF, &resources);
+  const long peak_rss_kb = resources.ru_maxrss;
+  const double seconds = elapsed.count();
+  const double records_per_second = seconds > 0 ? r.records / seconds : 0;
+
+  if (opts.csv) {
+    std::cout << opts.model << "," << (binary ? "binary" : "text") << ","
+              << r.records << "," << seconds << "," << records_per_second
+              << "," << peak_rss_kb << "," << r.interferences << std::endl;
+  } else {
+    std::cout << opts.model << ": " << r.records << " records ("
+              << (binary ? "binary" : "text") << ") in " << seconds << " s, "
+              << records_per_second << " records/s, peak RSS " << peak_rss_kb
+              << " KB, " << r.interferences << " interferences" << std::endl;
+  }
+  return 0;
+}
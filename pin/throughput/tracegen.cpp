@@ -0,0 +1,268 @@
+// Generates synthetic memory access traces, in pinatrace.out text or in the
+// binary format of detect/TraceFormat.h, to measure the throughput of the
+// analysis tools without running Pin.
+//
+// The working set is split into lines shared by every thread and lines
+// private to each thread, in proportion to the sharing ratio. Each access goes
+// to a shared line with probability equal to the sharing ratio, and otherwise
+// to one of the thread's private lines, chosen uniformly. The offset in the
+// line is chosen by the offset distribution:
+//   spread   each thread has its own slot in every line (false sharing)
+//   same     every thread uses the first slot of a line (true sharing)
+//   random   any slot, chosen uniformly (a mix of both)
+// Threads take turns in bursts of consecutive accesses, like the per-thread
+// buffers of the Pin tools.
+
+#include "../detect/TraceFormat.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace {
+
+// Main executable in the normalized addresses of modules.PH
+const uint64_t DATA_BASE = (uint64_t(1) << 48) | 0x4000;
+const uint64_t CODE_BASE = (uint64_t(1) << 48) | 0x1000;
+
+struct options {
+  std::string output = "synthetic.trace";
+  bool binary = false;
+  uint64_t records = 1000000;
+  uint64_t threads = 4;
+  uint64_t working_set = 64 * 1024;
+  double sharing = 0.5;
+  double writes = 0.3;
+  std::string offsets = "spread";
+  uint64_t access_size = 8;
+  uint64_t line_size = 64;
+  uint64_t burst = 1;
+  uint64_t seed = 1;
+};
+
+void usage(const char *argv0) {
+  std::cerr
+      << "Usage: " << argv0 << " [options]\n"
+      << "  -o PATH            output trace (synthetic.trace)\n"
+      << "  -format text|binary\n"
+      << "                     pinatrace.out text or TraceFormat.h (text)\n"
+      << "  -records N         number of accesses (1000000)\n"
+      << "  -threads N         number of threads (4)\n"
+      << "  -working-set N     bytes of data accessed (65536)\n"
+      << "  -sharing R         fraction of accesses to shared lines (0.5)\n"
+      << "  -writes R          fraction of accesses that are writes (0.3)\n"
+      << "  -offsets spread|same|random\n"
+      << "                     offsets used in shared lines (spread)\n"
+      << "  -size N            bytes per access (8)\n"
+      << "  -line-size N       cache line size in bytes (64)\n"
+      << "  -burst N           consecutive accesses per thread (1)\n"
+      << "  -seed N            random seed (1)" << std::endl;
+  exit(1);
+}
+
+class TraceWriter {
+public:
+  TraceWriter(std::ofstream &out, bool binary) : out(out), binary(binary) {}
+
+  void header(const options &opts) {
+    if (binary) {
+      char header[trace_header_size] = {};
+      std::copy(trace_magic, trace_magic + sizeof(trace_magic), header);
+      put_le(header + 8, trace_version, 4);
+      out.write(header, sizeof(header));
+      return;
+    }
+    out << "#\n"
+        << "# Synthetic memory access trace: " << opts.records
+        << " accesses, " << opts.threads << " threads, working set "
+        << opts.working_set << " bytes, sharing " << opts.sharing
+        << ", writes " << opts.writes << ", offsets " << opts.offsets
+        << ", seed " << opts.seed << "\n"
+        << "#\n";
+  }
+
+  void record(uint64_t ip, bool is_write, uint64_t addr, uint64_t size,
+              uint64_t thread) {
+    if (binary) {
+      char data[sizeof(trace_record)];
+      put_le(data, addr, 8);
+      put_le(data + 8, size, 4);
+      put_le(data + 12, thread, 2);
+      put_le(data + 14, is_write, 2);
+      out.write(data, sizeof(data));
+      return;
+    }
+    // Same columns as pinatrace: ip, R|W, address, size, thread, value
+    char line[96];
+    const int length =
+        snprintf(line, sizeof(line), "0x%016llx: %c 0x%016llx %2llu %llu 0x0\n",
+                 static_cast<unsigned long long>(ip), is_write ? 'W' : 'R',
+                 static_cast<unsigned long long>(addr),
+                 static_cast<unsigned long long>(size),
+                 static_cast<unsigned long long>(thread));
+    out.write(line, length);
+  }
+
+  void footer() {
+    if (!binary) {
+      out << "#eof\n";
+    }
+  }
+
+private:
+  std::ofstream &out;
+  bool binary;
+
+  static void put_le(char *data, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+      data[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+  }
+};
+
+uint64_t parse_uint(const char *flag, const char *value) {
+  char *end;
+  const unsigned long long parsed = strtoull(value, &end, 0);
+  if (*value == '\0' || *end != '\0') {
+    std::cerr << "Invalid value for " << flag << ": " << value << std::endl;
+    exit(1);
+  }
+  return parsed;
+}
+
+double parse_ratio(const char *flag, const char *value) {
+  char *end;
+  const double parsed = strtod(value, &end);
+  if (*value == '\0' || *end != '\0' || parsed < 0 || parsed > 1) {
+    std::cerr << flag << " must be between 0 and 1: " << value << std::endl;
+    exit(1);
+  }
+  return parsed;
+}
+
+options parse_options(int argc, char **argv) {
+  options opts;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg(argv[i]);
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+    }
+    const char *value = argv[++i];
+    if (arg == "-o") {
+      opts.output = value;
+    } else if (arg == "-format") {
+      opts.binary = std::string(value) == "binary";
+      if (!opts.binary && std::string(value) != "text") {
+        usage(argv[0]);
+      }
+    } else if (arg == "-records") {
+      opts.records = parse_uint(argv[i - 1], value);
+    } else if (arg == "-threads") {
+      opts.threads = parse_uint(argv[i - 1], value);
+    } else if (arg == "-working-set") {
+      opts.working_set = parse_uint(argv[i - 1], value);
+    } else if (arg == "-sharing") {
+      opts.sharing = parse_ratio(argv[i - 1], value);
+    } else if (arg == "-writes") {
+      opts.writes = parse_ratio(argv[i - 1], value);
+    } else if (arg == "-offsets") {
+      opts.offsets = value;
+      if (opts.offsets != "spread" && opts.offsets != "same" &&
+          opts.offsets != "random") {
+        usage(argv[0]);
+      }
+    } else if (arg == "-size") {
+      opts.access_size = parse_uint(argv[i - 1], value);
+    } else if (arg == "-line-size") {
+      opts.line_size = parse_uint(argv[i - 1], value);
+    } else if (arg == "-burst") {
+      opts.burst = parse_uint(argv[i - 1], value);
+    } else if (arg == "-seed") {
+      opts.seed = parse_uint(argv[i - 1], value);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (opts.threads == 0 || opts.threads > UINT16_MAX || opts.burst == 0 ||
+      opts.access_size == 0 || opts.line_size < opts.access_size ||
+      opts.line_size % opts.access_size) {
+    std::cerr << "Need 1 to " << UINT16_MAX
+              << " threads, a burst of at least 1 and an access size that "
+                 "divides the line size"
+              << std::endl;
+    exit(1);
+  }
+  return opts;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const options opts = parse_options(argc, argv);
+
+  // Shared lines first, then the private lines of each thread in turn
+  const uint64_t lines = std::max<uint64_t>(opts.working_set / opts.line_size,
+                                            opts.threads + 1);
+  uint64_t shared_lines = static_cast<uint64_t>(lines * opts.sharing);
+  if (opts.sharing > 0 && shared_lines == 0) {
+    shared_lines = 1;
+  }
+  if (opts.sharing < 1 && shared_lines == lines) {
+    shared_lines = lines - opts.threads;
+  }
+  const uint64_t private_lines = (lines - shared_lines) / opts.threads;
+  const uint64_t slots = opts.line_size / opts.access_size;
+
+  std::ofstream out(opts.output, std::ios::binary);
+  if (!out) {
+    std::cerr << "Could not open output file: " << opts.output << std::endl;
+    exit(1);
+  }
+  TraceWriter writer(out, opts.binary);
+  writer.header(opts);
+
+  std::mt19937_64 random(opts.seed);
+  std::uniform_real_distribution<double> unit(0, 1);
+  uint64_t thread = 0;
+  for (uint64_t i = 0; i < opts.records; i++) {
+    if (i && i % opts.burst == 0) {
+      thread = (thread + 1) % opts.threads;
+    }
+    const bool shared = private_lines == 0 || unit(random) < opts.sharing;
+    uint64_t line;
+    uint64_t slot;
+    if (shared) {
+      line = random() % shared_lines;
+      if (opts.offsets == "spread") {
+        slot = thread % slots;
+      } else if (opts.offsets == "same") {
+        slot = 0;
+      } else {
+        slot = random() % slots;
+      }
+    } else {
+      line = shared_lines + thread * private_lines + random() % private_lines;
+      slot = random() % slots;
+    }
+    const bool is_write = unit(random) < opts.writes;
+    const uint64_t addr =
+        DATA_BASE + line * opts.line_size + slot * opts.access_size;
+    // One instruction per thread and kind of access, as in a simple loop
+    const uint64_t ip = CODE_BASE + 8 * (2 * thread + is_write);
+    writer.record(ip, is_write, addr, opts.access_size, thread);
+  }
+  writer.footer();
+
+  if (!out) {
+    std::cerr << "Could not write output file: " << opts.output << std::endl;
+    exit(1);
+  }
+  std::cout << "Wrote " << opts.records << " accesses to " << opts.output
+            << std::endl;
+  return 0;
+}
@@ -2,13 +2,16 @@
 set -Eeuo pipefail 
 
 REPO_ROOT=$(pwd)
-BENCHNAME=basicLocks # Change if necessary
+BENCHNAME=${BENCHNAME:-basicLocks} # Change if necessary, or set in the environment
 BENCH=${REPO_ROOT}/bench/${BENCHNAME}
 BENCH=${REPO_ROOT}/bench/${BENCHNAME} 
-CACHELINESIZE=64 # Change if necessary
+CACHELINESIZE=${CACHELINESIZE:-64} # Change if necessary
+# Burst sampling for the Pin tools, e.g. (-sample_on 1000000 -sample_off 9000000)
+# to analyze 10% of each thread's accesses. Empty to analyze every access.
+SAMPLEFLAGS=()
 
 # Set up Intel Pin pinatrace
-PATH_TO_PIN=~/intel-pin/pin-3.21-98484-ge7cd811fd-gcc-linux/ # Change if necessary
+PATH_TO_PIN=${PATH_TO_PIN:-${HOME}/intel-pin/pin-3.21-98484-ge7cd811fd-gcc-linux/} # Change if necessary
 echo "Path to pin set as: ${PATH_TO_PIN}. Change this if necessary."
 echo
 
@@ -20,6 +23,8 @@ fi
 
 # Copy over modified pinatrace, and build pinatrace
 cp pin/pinatrace.cpp ${PINATRACE_DIR}
+cp pin/sampling.PH ${PINATRACE_DIR}
+cp pin/modules.PH ${PINATRACE_DIR}
 cd ${PINATRACE_DIR}
 make obj-intel64/pinatrace.so
 echo "Successfully compiled pinatrace.so"
@@ -37,7 +42,7 @@ echo
 
 # Clean up old files
 cd ${REPO_ROOT}
-rm -f *.out *.interferences fs_globals.txt ${REPO_ROOT}/src/mapped_conflicts.out
+rm -f *.out *.interferences *.threads *.fsp fs_globals.txt ${REPO_ROOT}/src/mapped_conflicts.out ${REPO_ROOT}/src/mapped_threads.out ${REPO_ROOT}/src/mapped_profile.fsp
 echo "Cleaned up old output files"
 echo
 
@@ -51,35 +56,28 @@ echo
 
 # Run pinatrace on the global pass 
 cd ${REPO_ROOT}
-${PATH_TO_PIN}/pin -t ${PINATRACE_DIR}/obj-intel64/pinatrace.so -- ${REPO_ROOT}/src/build/run/${BENCHNAME}_globals
+${PATH_TO_PIN}/pin -t ${PINATRACE_DIR}/obj-intel64/pinatrace.so "${SAMPLEFLAGS[@]}" -- ${REPO_ROOT}/src/build/run/${BENCHNAME}_globals
 echo "Successfully ran pinatrace on the globals pass. Got pinatrace.out as well as fs_globals.txt."
 echo
 
-# Run detect on pinatrace.out to get a list of interferences
-cd pin/detect 
-make clean
-make detect 
-./detect ${REPO_ROOT}/pinatrace.out $CACHELINESIZE
-DETECT_OUTPUT_FNAME=pinatrace.out.cacheline${CACHELINESIZE}.interferences
-echo "Successfully ran detect to produce ${DETECT_OUTPUT_FNAME}"
-echo
-
 # Run mdcache on the global pass 
 cd ${REPO_ROOT}
-${PATH_TO_PIN}/pin -t ${PINATRACE_DIR}/obj-intel64/mdcache.so -- ${REPO_ROOT}/src/build/run/${BENCHNAME}_globals
+${PATH_TO_PIN}/pin -t ${PINATRACE_DIR}/obj-intel64/mdcache.so "${SAMPLEFLAGS[@]}" -- ${REPO_ROOT}/src/build/run/${BENCHNAME}_globals
 MDCACHE_OUTPUT_FNAME=mdcache.out.cacheline64.interferences
 echo "Successfully ran mdcache on the globals pass. Got mdcache.out as well as ${MDCACHE_OUTPUT_FNAME}"
 echo
 
-# Run MapAddr to get mapped_conflicts.out
-cd pin/MapAddr 
-make clean 
-make all 
-./MapAddr "${REPO_ROOT}/${MDCACHE_OUTPUT_FNAME}" "${REPO_ROOT}/${DETECT_OUTPUT_FNAME}" "${REPO_ROOT}/fs_globals.txt"
-mv mapped_conflicts.out ${REPO_ROOT}
-cp ${REPO_ROOT}/mapped_conflicts.out ${REPO_ROOT}/src # So that manual runs of src/run.sh with fix will work
+# Run analyze to detect interferences in pinatrace.out, merge them with
+# mdcache's and map them to globals, all in one process. This is equivalent to
+# running pin/detect/detect and then pin/MapAddr/MapAddr on detect's output.
+cd pin/analyze
+make clean
+make all
+./analyze "${REPO_ROOT}/pinatrace.out" "${REPO_ROOT}/${MDCACHE_OUTPUT_FNAME}" "${REPO_ROOT}/fs_globals.txt" $CACHELINESIZE
+mv mapped_conflicts.out mapped_threads.out mapped_lines.out mapped_affinity.out mapped_profile.fsp ${REPO_ROOT}
+cp ${REPO_ROOT}/mapped_conflicts.out ${REPO_ROOT}/mapped_threads.out ${REPO_ROOT}/mapped_profile.fsp ${REPO_ROOT}/src # So that manual runs of src/run.sh with fix will work
 cd ${REPO_ROOT}
-echo "Successfully ran MapAddr to get mapped_conflicts.out"
+echo "Successfully ran analyze to get mapped_conflicts.out"
 echo 
 
 # Apply the fix LLVM pass
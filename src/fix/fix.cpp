@@ -1,21 +1,36 @@
 ///// LLVM analysis pass to mitigate false sharing based on profiling data /////
 #include "llvm/ADT/Optional.h"
+#include "llvm/ADT/bit.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/Pass.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/IR/ValueHandle.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <fstream>
+#include <map>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <set>
+#include <sstream>
 #include <vector>
 
+#include "../../pin/MapAddr/ProfileFormat.h"
+
 using namespace llvm;
 
 // Whether to enable struct padding. Struct padding is potentially unstable.
@@ -24,6 +39,84 @@ static const bool enableStructPadding = true;
 // This must be a power of 2 for other code to work.
 static const size_t cacheLineSize = 64; // in bytes
 
+// Whether to reorder struct fields into conflict-free clusters rather than
+// only inserting padding before each conflicting field.
+static cl::opt<bool> enableFieldReordering(
+  "fs-reorder-fields",
+  cl::desc("Reorder fields of falsely shared structs into cache line clusters"),
+  cl::init(false));
+
+// Fields whose writes are at most this fraction of their profiled accesses are
+// reordered as if they were read-only, as writes that rare (e.g. setting up a
+// flag once) cost less than a cache line of their own. Only binary profiles and
+// text ones with mapped_affinity.out count reads and writes.
+static cl::opt<double> readMostlyWrites(
+  "fs-read-mostly",
+  cl::desc("Maximum fraction of writes among the accesses to a read-mostly field"),
+  cl::init(0.01));
+
+// Whether to assume that the module is the whole program (e.g. when running
+// under LTO), so externally visible globals and functions may be rewritten.
+static cl::opt<bool> assumeWholeProgram(
+  "fs-whole-program",
+  cl::desc("Assume the module contains the whole program"),
+  cl::init(false));
+
+// Whether to pad the elements of falsely shared arrays to whole cache lines.
+static cl::opt<bool> enableArrayStriding(
+  "fs-stride-arrays",
+  cl::desc("Pad each element of falsely shared arrays to a cache line"),
+  cl::init(true));
+
+// Arrays are only strided if their conflicts between different elements add
+// up to at least this priority, and if the strided array is not too large.
+static cl::opt<uint64_t> strideMinPriority(
+  "fs-stride-min-priority",
+  cl::desc("Minimum total conflict priority for striding an array"),
+  cl::init(100));
+static cl::opt<uint64_t> strideMaxBytes(
+  "fs-stride-max-bytes",
+  cl::desc("Maximum size of a strided array, in bytes"),
+  cl::init(1 << 20));
+
+// Whether to privatize globals that are only updated with commutative
+// operations into thread-local copies that are reduced at thread exit. Reads
+// from other threads only see the updates of threads that have exited, so this
+// is only correct for counters that are read after the threads are joined.
+static cl::opt<bool> enablePrivatization(
+  "fs-privatize",
+  cl::desc("Privatize commutatively updated globals into thread-local copies"),
+  cl::init(false));
+
+// Whether to pack small conflicting globals that are accessed by the same
+// threads, and written by the same one, into shared cache lines, rather than
+// giving each its own line.
+static cl::opt<bool> enableGlobalPacking(
+  "fs-pack-globals",
+  cl::desc("Pack globals accessed by the same threads into shared cache lines"),
+  cl::init(true));
+
+// The layout of conflicts on cache lines where more than this fraction of the
+// sharing is true sharing is left alone: padding, striding or packing would
+// separate the falsely shared variables, but the line would keep bouncing
+// between cores, so the memory is better spent elsewhere. Such conflicts are
+// still privatization candidates, as privatization removes the true sharing.
+// Only binary profiles record true sharing.
+static cl::opt<double> maxTrueSharing(
+  "fs-max-true-sharing",
+  cl::desc("Maximum fraction of true sharing on a cache line for changing the layout of its conflicts"),
+  cl::init(0.5));
+
+// Profile written by MapAddr or analyze. Binary profiles are recognized by
+// their magic; anything else is read as mapped_conflicts.out text, with thread
+// information from mapped_threads.out and mapped_affinity.out in the working
+// directory.
+static cl::opt<std::string> profilePath(
+  "fs-profile",
+  cl::desc("Path to the false sharing profile (binary or text)"),
+  cl::value_desc("path"),
+  cl::init("mapped_conflicts.out"));
+
 namespace {
 struct CacheLineEntry {
   std::string variableName;
@@ -39,7 +132,58 @@ struct Conflict {
   CacheLineEntry entry1;
   CacheLineEntry entry2;
   uint64_t priority;
+  // Fraction of the sharing on the conflict's line that is true sharing
+  double trueSharing = 0;
+};
+}
+
+namespace {
+// How a thread accessed an offset or element during profiling. The counts are
+// 0 if the profile does not record them.
+struct ThreadAccess {
+  bool written = false;
+  uint64_t reads = 0;
+  uint64_t writes = 0;
+
+  void add(const ThreadAccess &other) {
+    written = written || other.written;
+    reads += other.reads;
+    writes += other.writes;
+  }
 };
+
+// thread -> how it accessed the offset or element, for the threads that
+// accessed it during profiling
+typedef std::map<uint64_t, ThreadAccess> ThreadAccesses;
+
+// Conflicts to fix, and the threads that accessed each conflicting global
+struct Profile {
+  std::vector<Conflict> conflicts;
+  // global -> offset within the global -> thread accesses
+  std::unordered_map<std::string, std::map<uint64_t, ThreadAccesses>> accesses;
+};
+}
+
+// Stands in for the threads that wrote a conflicting element when the profile
+// has no thread information.
+static const uint64_t unknownThread = UINT64_MAX;
+
+// <threads that wrote, other threads that read> a global or struct element.
+// Everything that shares its cache lines must have the same signature, or a
+// write to one would invalidate the line for a thread that only reads another.
+// Something only one thread accessed counts as written by it, and read-only
+// things get two empty sets, as nothing invalidates lines nobody writes.
+typedef std::pair<std::set<uint64_t>, std::set<uint64_t>> AccessSignature;
+
+static AccessSignature getAccessSignature(const std::set<uint64_t> &writers,
+                                          std::set<uint64_t> readers) {
+  if (writers.empty()) {
+    return readers.size() == 1 ? AccessSignature{readers, {}} : AccessSignature();
+  }
+  for (auto writer : writers) {
+    readers.erase(writer);
+  }
+  return {writers, readers};
 }
 
 std::istream &operator>>(std::istream &in, CacheLineEntry &entry) {
@@ -58,7 +202,8 @@ struct PaddedStruct {
     Module &M,
     const StructType *oldType,
     const StructLayout *oldLayout,
-    const std::set<unsigned int> &conflictingElements
+    const std::set<unsigned int> &conflictingElements,
+    bool wholeCacheLines = false
   ) {
 
     SmallVector<Type *> newTypes;
@@ -78,6 +223,54 @@ struct PaddedStruct {
       newElementByOldElement.emplace(i, static_cast<unsigned int>(newTypes.size() - 1));
     }
 
+    setType(M, oldType, newTypes, wholeCacheLines);
+  }
+
+  // Lays out each cluster of old elements contiguously, in the given order,
+  // starting every cluster after the first on a new cache line.
+  PaddedStruct(
+    Module &M,
+    const DataLayout &dataLayout,
+    const StructType *oldType,
+    const std::vector<std::vector<unsigned int>> &clusters,
+    bool wholeCacheLines = false
+  ) {
+
+    SmallVector<Type *> newTypes;
+    size_t offset = 0;
+    auto *int8Ty = Type::getInt8Ty(M.getContext());
+    for (size_t c = 0; c < clusters.size(); ++c) {
+      if (c > 0 && offset % cacheLineSize != 0) {
+        size_t paddingBytes = cacheLineSize - offset % cacheLineSize;
+        newTypes.push_back(ArrayType::get(int8Ty, paddingBytes));
+        offset += paddingBytes;
+      }
+      for (unsigned int i : clusters[c]) {
+        auto *elementType = oldType->getElementType(i);
+        offset = alignTo(offset, dataLayout.getABITypeAlign(elementType));
+        offset += dataLayout.getTypeAllocSize(elementType);
+        newTypes.push_back(elementType);
+        newElementByOldElement.emplace(i, static_cast<unsigned int>(newTypes.size() - 1));
+      }
+    }
+    assert(newElementByOldElement.size() == oldType->getNumElements());
+
+    setType(M, oldType, newTypes, wholeCacheLines);
+  }
+
+private:
+  // With wholeCacheLines, padding is added at the end so that the size is a
+  // multiple of the cache line size, and consecutive instances (in arrays or
+  // on the heap) do not share cache lines.
+  void setType(Module &M, const StructType *oldType, SmallVector<Type *> &newTypes,
+               bool wholeCacheLines) {
+    if (wholeCacheLines) {
+      uint64_t size = M.getDataLayout().getTypeAllocSize(StructType::get(M.getContext(), newTypes));
+      if (size % cacheLineSize != 0) {
+        newTypes.push_back(ArrayType::get(Type::getInt8Ty(M.getContext()),
+                                          alignTo(size, cacheLineSize) - size));
+      }
+    }
     if (oldType->hasName()) {
       type = StructType::create(newTypes, oldType->getName());
     } else {
@@ -87,6 +280,171 @@ struct PaddedStruct {
 };
 }
 
+namespace {
+// The elements of a struct that conflicted during profiling.
+struct ElementConflicts {
+  std::set<unsigned int> elements;
+  std::set<std::pair<unsigned int, unsigned int>> pairs; // distinct elements, lower first
+  std::map<unsigned int, ThreadAccesses> accesses;       // elements with thread information
+
+  void add(const StructLayout *layout, const std::pair<size_t, size_t> &offsets) {
+    unsigned int element1 = layout->getElementContainingOffset(offsets.first);
+    unsigned int element2 = layout->getElementContainingOffset(offsets.second);
+    elements.insert(element1);
+    elements.insert(element2);
+    if (element1 != element2) {
+      pairs.emplace(std::min(element1, element2), std::max(element1, element2));
+    }
+  }
+
+  void addAccesses(const StructLayout *layout, uint64_t offset, const ThreadAccesses &threads) {
+    if (offset >= layout->getSizeInBytes()) {
+      return;
+    }
+    auto &elementAccesses = accesses[layout->getElementContainingOffset(offset)];
+    for (auto &thread : threads) {
+      elementAccesses[thread.first].add(thread.second);
+    }
+  }
+
+  void print() const {
+    for (auto idx : elements) {
+      errs() << idx << ' ';
+    }
+    errs() << '\n';
+  }
+};
+}
+
+// Groups the elements of a struct into clusters such that only elements with
+// the same access signature (written by the same threads and read by the same
+// other threads) share a cluster, and no two elements that conflicted during
+// profiling do. Read-only and cold elements come first, so read-mostly fields
+// are kept apart from written ones even if their conflicts with them were too
+// rare to be recorded. Elements that were rarely written, see -fs-read-mostly,
+// count as read-only. Conflicting elements without thread information are
+// kept apart from the read-only ones.
+// Within a cluster, elements are sorted by decreasing alignment to minimize
+// the padding inserted by the struct layout.
+static std::vector<std::vector<unsigned int>> clusterElements(
+  const DataLayout &dataLayout,
+  const StructType *type,
+  const ElementConflicts &conflicts
+) {
+  std::vector<std::set<unsigned int>> neighbors(type->getNumElements());
+  for (auto &pair : conflicts.pairs) {
+    neighbors[pair.first].insert(pair.second);
+    neighbors[pair.second].insert(pair.first);
+  }
+
+  // access signature -> elements with exactly that signature
+  std::map<AccessSignature, std::vector<unsigned int>> elementsBySignature;
+  for (unsigned int i = 0; i < type->getNumElements(); ++i) {
+    std::set<uint64_t> writers, readers;
+    auto accesses = conflicts.accesses.find(i);
+    if (accesses != conflicts.accesses.end()) {
+      uint64_t reads = 0, writes = 0;
+      for (auto &thread : accesses->second) {
+        reads += thread.second.reads;
+        writes += thread.second.writes;
+      }
+      bool readMostly = reads + writes > 0 && writes <= readMostlyWrites * (reads + writes);
+      for (auto &thread : accesses->second) {
+        (thread.second.written && !readMostly ? writers : readers).insert(thread.first);
+      }
+    } else if (!neighbors[i].empty()) {
+      writers.insert(unknownThread);
+    }
+    elementsBySignature[getAccessSignature(writers, readers)].push_back(i);
+  }
+
+  std::vector<std::vector<unsigned int>> clusters;
+  for (auto &group : elementsBySignature) {
+    // Greedily color the conflict graph, most constrained elements first.
+    auto &order = group.second;
+    std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+      return neighbors[a].size() > neighbors[b].size();
+    });
+
+    size_t first = clusters.size();
+    clusters.emplace_back();
+    for (unsigned int element : order) {
+      size_t c = first;
+      for (; c < clusters.size(); ++c) {
+        bool fits = std::none_of(clusters[c].begin(), clusters[c].end(), [&](unsigned int other) {
+          return neighbors[element].count(other) > 0;
+        });
+        if (fits) {
+          break;
+        }
+      }
+      if (c == clusters.size()) {
+        clusters.emplace_back();
+      }
+      clusters[c].push_back(element);
+    }
+  }
+
+  for (auto &cluster : clusters) {
+    std::stable_sort(cluster.begin(), cluster.end(), [&](unsigned int a, unsigned int b) {
+      return dataLayout.getABITypeAlign(type->getElementType(a)) >
+             dataLayout.getABITypeAlign(type->getElementType(b));
+    });
+  }
+  return clusters;
+}
+
+static std::unique_ptr<PaddedStruct> makePaddedStruct(
+  Module &M,
+  const DataLayout &dataLayout,
+  StructType *type,
+  const ElementConflicts &conflicts,
+  bool wholeCacheLines = false
+) {
+  if (enableFieldReordering && !conflicts.pairs.empty()) {
+    auto clusters = clusterElements(dataLayout, type, conflicts);
+    errs() << "Reordering " << type->getName() << " into " << clusters.size()
+           << " cache line clusters\n";
+    return std::make_unique<PaddedStruct>(M, dataLayout, type, clusters, wholeCacheLines);
+  }
+  return std::make_unique<PaddedStruct>(M, type, dataLayout.getStructLayout(type), conflicts.elements,
+                                        wholeCacheLines);
+}
+
+// Computes the initializer of a padded replacement for globalVar. Returns false
+// if the initializer is in an unknown format.
+static bool padInitializer(const GlobalVariable *globalVar, PaddedStruct &padded,
+                           Constant *&initializer) {
+  initializer = nullptr;
+  if (!globalVar->hasInitializer()) {
+    return true;
+  }
+  if (auto *structInit = dyn_cast<ConstantStruct>(globalVar->getInitializer())) {
+    SmallVector<Constant *> fields;
+    fields.resize(padded.type->getNumElements(), nullptr);
+    for (auto &pair : padded.newElementByOldElement) {
+      unsigned int oldElement = pair.first;
+      unsigned int newElement = pair.second;
+      fields[newElement] = structInit->getOperand(oldElement);
+    }
+    for (unsigned int i = 0; i < fields.size(); ++i) {
+      if (!fields[i]) {
+        fields[i] = UndefValue::get(padded.type->getElementType(i));
+      }
+    }
+    initializer = ConstantStruct::get(padded.type, fields);
+  } else if (isa<ConstantAggregateZero>(globalVar->getInitializer())) {
+    initializer = ConstantAggregateZero::get(padded.type);
+  } else if (isa<PoisonValue>(globalVar->getInitializer())) {
+    initializer = PoisonValue::get(padded.type);
+  } else if (isa<UndefValue>(globalVar->getInitializer())) {
+    initializer = UndefValue::get(padded.type);
+  } else {
+    return false;
+  }
+  return true;
+}
+
 static bool fixGlobalStruct(Module &M, GlobalVariable *globalVar, PaddedStruct &padded) {
   for (auto *user : globalVar->users()) {
     if (auto *gepInst = dyn_cast<GetElementPtrInst>(user)) {
@@ -132,34 +490,12 @@ static bool fixGlobalStruct(Module &M, GlobalVariable *globalVar, PaddedStruct &
     }
   }
 
-  auto *int8Ty = Type::getInt8Ty(globalVar->getContext());
-
   Constant *initializer = nullptr;
-  if (auto *structInit = dyn_cast<ConstantStruct>(globalVar->getInitializer())) {
-    SmallVector<Constant *> fields;
-    fields.resize(padded.type->getNumElements(), nullptr);
-    for (auto &pair : padded.newElementByOldElement) {
-      unsigned int oldElement = pair.first;
-      unsigned int newElement = pair.second;
-      fields[newElement] = structInit->getOperand(oldElement);
-    }
-    for (unsigned int i = 0; i < fields.size(); ++i) {
-      if (!fields[i]) {
-        fields[i] = UndefValue::get(padded.type->getElementType(i));
-      }
-    }
-    initializer = ConstantStruct::get(padded.type, fields);
-  } else if (auto *zeroInit = dyn_cast<ConstantAggregateZero>(globalVar->getInitializer())) {
-    initializer = ConstantAggregateZero::get(padded.type);
-  } else if (auto *poisonInit = dyn_cast<PoisonValue>(globalVar->getInitializer())) {
-    initializer = PoisonValue::get(padded.type);
-  } else if (auto *undefInit = dyn_cast<UndefValue>(globalVar->getInitializer())) {
-    initializer = UndefValue::get(padded.type);
-  } else if (globalVar->getInitializer() != nullptr) {
+  if (!padInitializer(globalVar, padded, initializer)) {
     errs() << "Unable to pad struct - unknown initializer format\n";
     return false;
   }
-  
+
   errs() << "Replacing " << globalVar->getName() << " with new, padded global\n";
 
   auto *newGlobalVar = new GlobalVariable(
@@ -220,109 +556,1594 @@ static bool fixGlobalStruct(Module &M, GlobalVariable *globalVar, PaddedStruct &
   for (auto *inst : toErase) {
     inst->eraseFromParent();
   }
+  newGlobalVar->takeName(globalVar);
   globalVar->eraseFromParent();
 
   return true;
 }
 
-namespace{
-struct Fix583 : public ModulePass {
-  static char ID;
+// Whether every use of a pointer to an array element only accesses that
+// element, so that moving the element elsewhere is safe.
+static bool onlyAccessesElement(const Value *elementPtr) {
+  for (auto *user : elementPtr->users()) {
+    if (isa<LoadInst>(user)) {
+      continue;
+    }
+    if (auto *store = dyn_cast<StoreInst>(user)) {
+      if (store->getValueOperand() == elementPtr) {
+        return false;
+      }
+      continue;
+    }
+    if (auto *rmw = dyn_cast<AtomicRMWInst>(user)) {
+      if (rmw->getValOperand() == elementPtr) {
+        return false;
+      }
+      continue;
+    }
+    if (auto *cmpXchg = dyn_cast<AtomicCmpXchgInst>(user)) {
+      if (cmpXchg->getPointerOperand() != elementPtr) {
+        return false;
+      }
+      continue;
+    }
+    if (auto *gep = dyn_cast<GEPOperator>(user)) {
+      // Addressing within the element is fine; stepping to a neighbor is not.
+      auto *first = dyn_cast<ConstantInt>(gep->idx_begin()->get());
+      if (gep->getNumIndices() >= 2 && first && first->isZero()) {
+        continue;
+      }
+      return false;
+    }
+    return false;
+  }
+  return true;
+}
 
-  // TODO: Come up with a better way of taking input.
-  // Maybe consider doing something similar to profiling passes.
-  static const std::string inputFile;
+// Replaces an array global with one whose elements are each padded to a
+// multiple of the cache line size, so that threads working on different
+// elements never share a cache line.
+static bool fixGlobalArray(Module &M, GlobalVariable *globalVar) {
+  auto &dataLayout = M.getDataLayout();
+  auto *arrayType = cast<ArrayType>(globalVar->getValueType());
+  auto *elementType = arrayType->getElementType();
+  uint64_t elementSize = dataLayout.getTypeAllocSize(elementType);
+  if (elementSize == 0 || elementSize % cacheLineSize == 0) {
+    return false;
+  }
+  uint64_t stridedElementSize = alignTo(elementSize, cacheLineSize);
+  if (stridedElementSize * arrayType->getNumElements() > strideMaxBytes) {
+    errs() << "Unable to stride array " << globalVar->getName() << " - strided array too large\n";
+    return false;
+  }
+  if (!GlobalValue::isLocalLinkage(globalVar->getLinkage()) && !assumeWholeProgram) {
+    errs() << "Unable to stride array " << globalVar->getName() << " - externally visible\n";
+    return false;
+  }
 
+  for (auto *user : globalVar->users()) {
+    if (auto *gep = dyn_cast<GEPOperator>(user)) {
+      if (gep->getPointerOperand() != globalVar || gep->getNumIndices() < 2) {
+        errs() << "Unable to stride array - used in array-style GetElementPtr\n";
+        return false;
+      }
+      auto *first = dyn_cast<ConstantInt>(gep->idx_begin()->get());
+      if (!first || !first->isZero()) {
+        errs() << "Unable to stride array - GetElementPtr steps over the whole array\n";
+        return false;
+      }
+      if (gep->getNumIndices() == 2 && !onlyAccessesElement(gep)) {
+        errs() << "Unable to stride array - element pointer used for pointer arithmetic or escapes\n";
+        return false;
+      }
+    } else if (auto *castOp = dyn_cast<BitCastOperator>(user)) {
+      if (castOp->getDestTy() != elementType->getPointerTo(globalVar->getAddressSpace()) ||
+          !onlyAccessesElement(castOp)) {
+        errs() << "Unable to stride array - used in unfixable bitcast\n";
+        return false;
+      }
+    } else {
+      errs() << "Unable to stride array - used in unfixable instruction or constant expression\n";
+      return false;
+    }
+  }
 
-  std::vector<Conflict> getPotentialFS() {
-    std::ifstream in(inputFile);
+  auto &context = M.getContext();
+  auto *int8Ty = Type::getInt8Ty(context);
+  auto *int32Ty = Type::getInt32Ty(context);
+  auto *int64Ty = Type::getInt64Ty(context);
+  auto *paddingType = ArrayType::get(int8Ty, stridedElementSize - elementSize);
+  auto *stridedElementType = StructType::get(context, {elementType, paddingType});
+  auto *stridedType = ArrayType::get(stridedElementType, arrayType->getNumElements());
 
-    std::vector<Conflict> conflicts;
-    Conflict conflict;
-    while (in >> conflict) {
-      conflicts.push_back(std::move(conflict));
+  Constant *initializer = nullptr;
+  if (globalVar->hasInitializer()) {
+    auto *oldInitializer = globalVar->getInitializer();
+    if (isa<ConstantAggregateZero>(oldInitializer)) {
+      initializer = ConstantAggregateZero::get(stridedType);
+    } else if (isa<UndefValue>(oldInitializer)) {
+      initializer = UndefValue::get(stridedType);
+    } else {
+      SmallVector<Constant *> elements;
+      for (unsigned int i = 0; i < arrayType->getNumElements(); ++i) {
+        auto *element = oldInitializer->getAggregateElement(i);
+        if (!element) {
+          errs() << "Unable to stride array - unknown initializer format\n";
+          return false;
+        }
+        elements.push_back(ConstantStruct::get(stridedElementType,
+                                               {element, UndefValue::get(paddingType)}));
+      }
+      initializer = ConstantArray::get(stridedType, elements);
     }
+  }
+
+  errs() << "Striding array " << globalVar->getName() << ": " << elementSize << " -> "
+         << stridedElementSize << " bytes per element\n";
+
+  auto *newGlobalVar = new GlobalVariable(
+    M,
+    stridedType,
+    globalVar->isConstant(),
+    globalVar->getLinkage(),
+    initializer,
+    "",
+    globalVar,
+    globalVar->getThreadLocalMode(),
+    globalVar->getAddressSpace(),
+    globalVar->isExternallyInitialized());
+  newGlobalVar->setAlignment(Align(cacheLineSize));
+
+  // Array indices (0, i, rest...) become (0, i, 0, rest...).
+  auto stridedIndices = [&](GEPOperator *gep) {
+    SmallVector<Value *> indices(gep->indices());
+    indices.insert(indices.begin() + 2, ConstantInt::get(int32Ty, 0));
+    return indices;
+  };
+  Value *firstElementIndices[] = {
+    ConstantInt::get(int64Ty, 0), ConstantInt::get(int64Ty, 0), ConstantInt::get(int32Ty, 0)
+  };
 
-    return conflicts;
+  SmallVector<User *> users(globalVar->users());
+  for (auto *user : users) {
+    if (auto *gepInst = dyn_cast<GetElementPtrInst>(user)) {
+      auto *newInst = GetElementPtrInst::Create(stridedType, newGlobalVar,
+                                                stridedIndices(cast<GEPOperator>(gepInst)),
+                                                "", gepInst);
+      newInst->setIsInBounds(gepInst->isInBounds());
+      newInst->takeName(gepInst);
+      gepInst->replaceAllUsesWith(newInst);
+      gepInst->eraseFromParent();
+    } else if (auto *constExpr = dyn_cast<ConstantExpr>(user)) {
+      SmallVector<Constant *> indices;
+      if (auto *gep = dyn_cast<GEPOperator>(constExpr)) {
+        for (auto *index : stridedIndices(gep)) {
+          indices.push_back(cast<Constant>(index));
+        }
+      } else {
+        for (auto *index : firstElementIndices) {
+          indices.push_back(cast<Constant>(index));
+        }
+      }
+      auto *newConstExpr = ConstantExpr::getInBoundsGetElementPtr(stridedType, newGlobalVar, indices);
+      constExpr->replaceAllUsesWith(newConstExpr);
+    } else {
+      auto *castInst = cast<BitCastInst>(user);
+      auto *newInst = GetElementPtrInst::CreateInBounds(stridedType, newGlobalVar,
+                                                        firstElementIndices, "", castInst);
+      newInst->takeName(castInst);
+      castInst->replaceAllUsesWith(newInst);
+      castInst->eraseFromParent();
+    }
   }
 
-  Fix583() : ModulePass(ID) {}
+  globalVar->removeDeadConstantUsers();
+  newGlobalVar->takeName(globalVar);
+  globalVar->eraseFromParent();
+  return true;
+}
 
-  bool runOnModule(Module &M) override {
-    bool changed = false;
-    auto conflicts = getPotentialFS();
-    std::sort(conflicts.begin(), conflicts.end(), [](auto &c1, auto &c2) {
-      return c1.priority > c2.priority;
-    });
+namespace {
+// An update of a privatizable global, either load-op-store or atomicrmw.
+struct CommutativeUpdate {
+  LoadInst *load;         // null for atomicrmw
+  Instruction *operation; // the binary operator, min/max intrinsic, or atomicrmw
+  Instruction *store;     // the store, or the atomicrmw
+};
+}
 
-    auto &dataLayout = M.getDataLayout();
+// Returns the atomicrmw operation that reduces the given update of load, or
+// None if the update is not commutative. Subtraction is reduced with addition.
+static Optional<AtomicRMWInst::BinOp> getUpdateKind(const Instruction *operation,
+                                                    const LoadInst *load) {
+  if (auto *rmw = dyn_cast<AtomicRMWInst>(operation)) {
+    switch (rmw->getOperation()) {
+      case AtomicRMWInst::Add:
+      case AtomicRMWInst::Sub:
+        return AtomicRMWInst::Add;
+      case AtomicRMWInst::Or:
+      case AtomicRMWInst::And:
+      case AtomicRMWInst::Xor:
+      case AtomicRMWInst::Max:
+      case AtomicRMWInst::Min:
+      case AtomicRMWInst::UMax:
+      case AtomicRMWInst::UMin:
+        return rmw->getOperation();
+      default:
+        return None;
+    }
+  }
+  if (operation->getNumOperands() < 2 ||
+      (operation->getOperand(0) == load) == (operation->getOperand(1) == load)) {
+    return None; // the loaded value must be exactly one of the operands
+  }
+  if (auto *binary = dyn_cast<BinaryOperator>(operation)) {
+    switch (binary->getOpcode()) {
+      case Instruction::Add: return AtomicRMWInst::Add;
+      case Instruction::Sub:
+        if (binary->getOperand(0) != load) {
+          return None;
+        }
+        return AtomicRMWInst::Add;
+      case Instruction::Or: return AtomicRMWInst::Or;
+      case Instruction::And: return AtomicRMWInst::And;
+      case Instruction::Xor: return AtomicRMWInst::Xor;
+      default: return None;
+    }
+  }
+  if (auto *intrinsic = dyn_cast<IntrinsicInst>(operation)) {
+    switch (intrinsic->getIntrinsicID()) {
+      case Intrinsic::smax: return AtomicRMWInst::Max;
+      case Intrinsic::smin: return AtomicRMWInst::Min;
+      case Intrinsic::umax: return AtomicRMWInst::UMax;
+      case Intrinsic::umin: return AtomicRMWInst::UMin;
+      default: return None;
+    }
+  }
+  return None;
+}
 
-    std::unordered_map<StructType *, std::unordered_map<GlobalVariable *, std::set<size_t>>> structAccesses;
+static Constant *getIdentity(AtomicRMWInst::BinOp kind, IntegerType *type) {
+  switch (kind) {
+    case AtomicRMWInst::And:
+    case AtomicRMWInst::UMin:
+      return ConstantInt::get(type, APInt::getAllOnes(type->getBitWidth()));
+    case AtomicRMWInst::Max:
+      return ConstantInt::get(type, APInt::getSignedMinValue(type->getBitWidth()));
+    case AtomicRMWInst::Min:
+      return ConstantInt::get(type, APInt::getSignedMaxValue(type->getBitWidth()));
+    default:
+      return ConstantInt::get(type, 0);
+  }
+}
 
-    Optional<uint64_t> priorityThreshold;
+// Applies an atomicrmw operation to two values without atomicity.
+static Value *applyUpdate(IRBuilder<> &builder, AtomicRMWInst::BinOp kind, Value *lhs, Value *rhs) {
+  switch (kind) {
+    case AtomicRMWInst::Add: return builder.CreateAdd(lhs, rhs);
+    case AtomicRMWInst::Sub: return builder.CreateSub(lhs, rhs);
+    case AtomicRMWInst::Or: return builder.CreateOr(lhs, rhs);
+    case AtomicRMWInst::And: return builder.CreateAnd(lhs, rhs);
+    case AtomicRMWInst::Xor: return builder.CreateXor(lhs, rhs);
+    case AtomicRMWInst::Max: return builder.CreateBinaryIntrinsic(Intrinsic::smax, lhs, rhs);
+    case AtomicRMWInst::Min: return builder.CreateBinaryIntrinsic(Intrinsic::smin, lhs, rhs);
+    case AtomicRMWInst::UMax: return builder.CreateBinaryIntrinsic(Intrinsic::umax, lhs, rhs);
+    case AtomicRMWInst::UMin: return builder.CreateBinaryIntrinsic(Intrinsic::umin, lhs, rhs);
+    default: llvm_unreachable("Unexpected update kind");
+  }
+}
 
-    for (auto &conflict : conflicts) {
-      if (!priorityThreshold) {
-        priorityThreshold = conflict.priority / 1000;
-      }
-      if (conflict.priority < *priorityThreshold) {
-        break;
-      }
-      auto *global1 = M.getGlobalVariable(conflict.entry1.variableName, true);
-      auto *global2 = M.getGlobalVariable(conflict.entry2.variableName, true);
-      if (!global1) {
-        errs() << "Did not find global with name " << conflict.entry1.variableName << '\n';
-        continue;
-      }
-      if (!global2) {
-        errs() << "Did not find global with name " << conflict.entry2.variableName << '\n';
-        continue;
+// Replaces updates of a global that is only updated with one commutative
+// operation with updates of a thread-local copy. Each thread registers a
+// destructor on its first update that reduces its copy into the global when
+// the thread exits, and reads combine the global with the reading thread's
+// own copy.
+static bool privatizeGlobal(Module &M, GlobalVariable *globalVar) {
+  auto *type = dyn_cast<IntegerType>(globalVar->getValueType());
+  if (!type || !globalVar->hasInitializer() || globalVar->isConstant() ||
+      globalVar->isThreadLocal()) {
+    errs() << "Unable to privatize " << globalVar->getName() << " - not a mutable integer\n";
+    return false;
+  }
+  if (!GlobalValue::isLocalLinkage(globalVar->getLinkage()) && !assumeWholeProgram) {
+    errs() << "Unable to privatize " << globalVar->getName() << " - externally visible\n";
+    return false;
+  }
+
+  SmallVector<CommutativeUpdate> updates;
+  SmallVector<LoadInst *> reads;
+  std::set<Instruction *> updateStores;
+  Optional<AtomicRMWInst::BinOp> kind;
+  auto setKind = [&](Optional<AtomicRMWInst::BinOp> updateKind) {
+    if (!updateKind || (kind && *kind != *updateKind)) {
+      return false;
+    }
+    kind = updateKind;
+    return true;
+  };
+
+  for (auto *user : globalVar->users()) {
+    if (auto *load = dyn_cast<LoadInst>(user)) {
+      if (load->isVolatile() || !load->isUnordered()) {
+        errs() << "Unable to privatize " << globalVar->getName() << " - volatile or ordered load\n";
+        return false;
       }
-      if (conflict.entry1.variableName == conflict.entry2.variableName) {
-        if (auto *type = dyn_cast<StructType>(global1->getValueType())) {
-          if (enableStructPadding && GlobalValue::isLocalLinkage(global1->getLinkage())) {
-            auto &set = structAccesses[type][global1];
-            set.insert(conflict.entry1.accessOffsetInVariable);
-            set.insert(conflict.entry2.accessOffsetInVariable);
-          }
+      auto *operation = load->hasOneUse() ? dyn_cast<Instruction>(*load->user_begin()) : nullptr;
+      auto *store = operation && operation->hasOneUse()
+        ? dyn_cast<StoreInst>(*operation->user_begin()) : nullptr;
+      if (store && store->getPointerOperand() == globalVar &&
+          store->getValueOperand() == operation && !store->isVolatile() &&
+          store->isUnordered() && store->getParent() == load->getParent() &&
+          operation->getParent() == load->getParent()) {
+        if (!setKind(getUpdateKind(operation, load))) {
+          errs() << "Unable to privatize " << globalVar->getName()
+                 << " - not updated with a single commutative operation\n";
+          return false;
         }
+        // In g = g + g both loads would be updates sharing one store.
+        auto *other = dyn_cast<LoadInst>(operation->getOperand(operation->getOperand(0) == load));
+        if ((other && other->getPointerOperand()->stripPointerCasts() == globalVar) ||
+            !updateStores.insert(store).second) {
+          errs() << "Unable to privatize " << globalVar->getName()
+                 << " - updated with its own value\n";
+          return false;
+        }
+        updates.push_back({load, operation, store});
       } else {
-        errs() << "Aligning " << conflict.entry1.variableName << " to cache boundary\n";
-        global1->setAlignment(Align(cacheLineSize));
-        errs() << "Aligning " << conflict.entry2.variableName << " to cache boundary\n";
-        global2->setAlignment(Align(cacheLineSize));
-        changed = true;
+        reads.push_back(load);
+      }
+    } else if (auto *rmw = dyn_cast<AtomicRMWInst>(user)) {
+      if (rmw->isVolatile() || !rmw->use_empty() || rmw->getPointerOperand() != globalVar ||
+          !setKind(getUpdateKind(rmw, nullptr))) {
+        errs() << "Unable to privatize " << globalVar->getName()
+               << " - atomic update is not a single unused commutative operation\n";
+        return false;
       }
+      updates.push_back({nullptr, rmw, rmw});
+    } else if (!isa<StoreInst>(user)) {
+      errs() << "Unable to privatize " << globalVar->getName() << " - used in unfixable way\n";
+      return false;
     }
-
-    std::unordered_map<std::string, PaddedStruct> replacements;
-    for (auto &pair : structAccesses) {
-      auto *type = pair.first;
+  }
+  for (auto *user : globalVar->users()) {
+    if (isa<StoreInst>(user) && updateStores.count(cast<Instruction>(user)) == 0) {
+      errs() << "Unable to privatize " << globalVar->getName() << " - assigned directly\n";
+      return false;
+    }
+  }
+  if (updates.empty()) {
+    return false;
+  }
+
+  errs() << "Privatizing " << globalVar->getName() << " into thread-local copies ("
+         << updates.size() << " updates, " << reads.size() << " reads)\n";
+
+  auto &context = M.getContext();
+  IRBuilder<> builder(context);
+  auto *identity = getIdentity(*kind, type);
+  auto *privateVar = new GlobalVariable(
+    M, type, false, GlobalValue::InternalLinkage, identity,
+    globalVar->getName() + ".private", nullptr, GlobalValue::GeneralDynamicTLSModel);
+  auto *registeredVar = new GlobalVariable(
+    M, builder.getInt8Ty(), false, GlobalValue::InternalLinkage, builder.getInt8(0),
+    globalVar->getName() + ".registered", nullptr, GlobalValue::GeneralDynamicTLSModel);
+
+  // def flush(void *): global op= private; private = identity
+  auto *flush = Function::Create(
+    FunctionType::get(builder.getVoidTy(), {builder.getInt8PtrTy()}, false),
+    Function::InternalLinkage,
+    globalVar->getName() + ".flush",
+    M);
+  builder.SetInsertPoint(BasicBlock::Create(context, "flush", flush));
+  builder.CreateAtomicRMW(*kind, globalVar, builder.CreateLoad(type, privateVar),
+                          globalVar->getAlign(), AtomicOrdering::SequentiallyConsistent);
+  builder.CreateStore(identity, privateVar);
+  builder.CreateRetVoid();
+
+  // int __cxa_thread_atexit(void (*)(void *), void *, void *dso_handle);
+  auto threadAtExit = M.getOrInsertFunction(
+    "__cxa_thread_atexit",
+    builder.getInt32Ty(), flush->getType(), builder.getInt8PtrTy(), builder.getInt8PtrTy());
+  auto *dsoHandle = cast<GlobalVariable>(M.getOrInsertGlobal("__dso_handle", builder.getInt8Ty()));
+  if (dsoHandle->isDeclaration()) {
+    dsoHandle->setVisibility(GlobalValue::HiddenVisibility);
+  }
+
+  for (auto &update : updates) {
+    Instruction *first = update.load ? update.load : update.store;
+
+    // if (!registered) { registered = 1; __cxa_thread_atexit(flush, null, &__dso_handle); }
+    builder.SetInsertPoint(first);
+    auto *isRegistered = builder.CreateLoad(builder.getInt8Ty(), registeredVar);
+    auto *registerBranch = SplitBlockAndInsertIfThen(
+      builder.CreateICmpEQ(isRegistered, builder.getInt8(0)), first, false);
+    builder.SetInsertPoint(registerBranch);
+    builder.CreateStore(builder.getInt8(1), registeredVar);
+    builder.CreateCall(threadAtExit, {flush, ConstantPointerNull::get(builder.getInt8PtrTy()),
+                                      dsoHandle});
+
+    builder.SetInsertPoint(update.store);
+    auto *privateValue = builder.CreateLoad(type, privateVar);
+    Value *newValue;
+    if (auto *rmw = dyn_cast<AtomicRMWInst>(update.store)) {
+      newValue = applyUpdate(builder, rmw->getOperation(), privateValue, rmw->getValOperand());
+    } else {
+      auto *newOperation = update.operation->clone();
+      newOperation->replaceUsesOfWith(update.load, privateValue);
+      builder.Insert(newOperation);
+      newValue = newOperation;
+    }
+    builder.CreateStore(newValue, privateVar);
+
+    update.store->eraseFromParent();
+    if (update.load) {
+      update.operation->eraseFromParent();
+      update.load->eraseFromParent();
+    }
+  }
+
+  for (auto *read : reads) {
+    builder.SetInsertPoint(read->getNextNode());
+    auto *privateValue = builder.CreateLoad(type, privateVar);
+    auto *combined = applyUpdate(builder, *kind, read, privateValue);
+    read->replaceUsesWithIf(combined, [&](Use &use) { return use.getUser() != combined; });
+  }
+  return true;
+}
+
+// Returns whether type is target or (transitively) contains target by value.
+static bool containsType(Type *type, Type *target) {
+  if (type == target) {
+    return true;
+  }
+  if (auto *structType = dyn_cast<StructType>(type)) {
+    return std::any_of(structType->element_begin(), structType->element_end(),
+                       [&](Type *element) { return containsType(element, target); });
+  }
+  if (auto *arrayType = dyn_cast<ArrayType>(type)) {
+    return containsType(arrayType->getElementType(), target);
+  }
+  if (auto *vectorType = dyn_cast<VectorType>(type)) {
+    return containsType(vectorType->getElementType(), target);
+  }
+  return false;
+}
+
+static bool isAllocationFunction(const Function *F) {
+  if (!F) {
+    return false;
+  }
+  auto name = F->getName();
+  return name == "malloc" || name == "_Znwm" || name == "_Znam";
+}
+
+static bool isDeallocationFunction(const Function *F) {
+  if (!F) {
+    return false;
+  }
+  auto name = F->getName();
+  return name == "free" || name == "_ZdlPv" || name == "_ZdaPv" ||
+         name == "_ZdlPvm" || name == "_ZdaPvm";
+}
+
+// Replaces a call or invoke with one of callee with the given arguments.
+static CallBase *replaceCall(CallBase *call, FunctionCallee callee, ArrayRef<Value *> args) {
+  CallBase *newCall;
+  if (auto *invoke = dyn_cast<InvokeInst>(call)) {
+    newCall = InvokeInst::Create(callee, invoke->getNormalDest(), invoke->getUnwindDest(), args,
+                                 "", call);
+  } else {
+    newCall = CallInst::Create(callee, args, "", call);
+  }
+  newCall->setDebugLoc(call->getDebugLoc());
+  newCall->takeName(call);
+  call->replaceAllUsesWith(newCall);
+  call->eraseFromParent();
+  return newCall;
+}
+
+namespace {
+// Rewrites every instance of a struct type in a module - globals, allocas and
+// heap allocations - to use a padded layout. Pointers keep their original type;
+// only the code that depends on the layout (field addresses, element strides
+// and sizes) is rewritten, through bitcasts to the padded type. The padded
+// type must be a whole number of cache lines: instances are allocated on cache
+// line boundaries, on the heap with the aligned allocation functions, so that
+// neighboring instances never share a line.
+class StructTypeRewriter {
+public:
+  StructTypeRewriter(Module &M, StructType *oldType, PaddedStruct &padded)
+      : M(M), oldType(oldType), padded(padded),
+        oldSize(M.getDataLayout().getTypeAllocSize(oldType)),
+        newSize(M.getDataLayout().getTypeAllocSize(padded.type)) {}
+
+  // Checks that every use of the type in the module can be rewritten, printing
+  // the reason if not.
+  bool canRewrite() {
+    if (oldSize == 0) {
+      return fail("empty struct");
+    }
+    // Sizes and casts are only found through typed pointers to the struct;
+    // with opaque pointers they would be missed while its fields move.
+    if (!M.getContext().supportsTypedPointers()) {
+      return fail("opaque pointers");
+    }
+    for (auto *structType : M.getIdentifiedStructTypes()) {
+      if (structType != oldType && structType != padded.type &&
+          containsType(structType, oldType)) {
+        return fail("nested in another struct type");
+      }
+    }
+
+    for (auto &global : M.globals()) {
+      if (global.getValueType() == oldType) {
+        Constant *initializer;
+        if (global.getType()->isOpaque()) {
+          return fail("opaque pointers");
+        }
+        if (global.isDeclaration()) {
+          return fail("external global declaration");
+        }
+        if (!global.hasLocalLinkage() && !assumeWholeProgram) {
+          return fail("externally visible global");
+        }
+        if (!padInitializer(&global, padded, initializer)) {
+          return fail("unknown initializer format");
+        }
+        globals.push_back(&global);
+      } else if (containsType(global.getValueType(), oldType)) {
+        return fail("nested in a global of another type");
+      }
+      if (global.hasInitializer() && !scanConstant(global.getInitializer())) {
+        return false;
+      }
+    }
+
+    for (auto &F : M) {
+      if (!checkSignature(F)) {
+        return false;
+      }
+      for (auto &BB : F) {
+        for (auto &I : BB) {
+          if (!scanInstruction(I)) {
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+  void rewrite() {
+    auto *int32Ty = Type::getInt32Ty(M.getContext());
+    auto &dataLayout = M.getDataLayout();
+
+    for (auto *globalVar : globals) {
+      Constant *initializer;
+      padInitializer(globalVar, padded, initializer);
+      auto *newGlobalVar = new GlobalVariable(
+        M,
+        padded.type,
+        globalVar->isConstant(),
+        globalVar->getLinkage(),
+        initializer,
+        "",
+        globalVar,
+        globalVar->getThreadLocalMode(),
+        globalVar->getAddressSpace(),
+        globalVar->isExternallyInitialized());
+      newGlobalVar->setAlignment(Align(cacheLineSize));
+      newStorage[globalVar] = newGlobalVar;
+    }
+
+    for (auto *alloca : allocas) {
+      auto *newAlloca = new AllocaInst(
+        padded.type,
+        alloca->getType()->getAddressSpace(),
+        alloca->getArraySize(),
+        std::max(alloca->getAlign(), Align(cacheLineSize)),
+        "",
+        alloca);
+      newStorage[alloca] = newAlloca;
+    }
+
+    auto *sizeTy = dataLayout.getIntPtrType(M.getContext());
+    auto *align = ConstantInt::get(sizeTy, cacheLineSize);
+    for (auto *call : allocations) {
+      auto *size = cast<ConstantInt>(call->getArgOperand(0));
+      auto *rescaledSize = ConstantInt::get(size->getType(), rescale(size->getZExtValue()));
+      auto name = call->getCalledFunction()->getName();
+      if (name == "malloc") {
+        auto alignedAlloc = M.getOrInsertFunction("aligned_alloc", call->getType(), sizeTy,
+                                                  size->getType());
+        replaceCall(call, alignedAlloc, {align, rescaledSize});
+      } else {
+        // operator new(size_t, std::align_val_t) and operator new[]
+        auto alignedNew = M.getOrInsertFunction((name + "St11align_val_t").str(), call->getType(),
+                                                size->getType(), sizeTy);
+        replaceCall(call, alignedNew, {rescaledSize, align});
+      }
+    }
+    for (auto *call : deallocations) {
+      auto name = call->getCalledFunction()->getName();
+      if (name == "free") {
+        continue; // also frees aligned_alloc memory
+      }
+      // operator delete(void *, std::align_val_t), with the size before the
+      // alignment for sized deletes, and operator delete[]
+      SmallVector<Value *> args{call->getArgOperand(0)};
+      if (call->arg_size() > 1) {
+        auto *size = cast<ConstantInt>(call->getArgOperand(1));
+        args.push_back(ConstantInt::get(size->getType(), rescale(size->getZExtValue())));
+      }
+      args.push_back(align);
+      SmallVector<Type *> argTypes;
+      for (auto *arg : args) {
+        argTypes.push_back(arg->getType());
+      }
+      auto alignedDelete = M.getOrInsertFunction(
+        (name + "St11align_val_t").str(),
+        FunctionType::get(Type::getVoidTy(M.getContext()), argTypes, false));
+      replaceCall(call, alignedDelete, args);
+    }
+    for (auto *intrinsic : sizedIntrinsics) {
+      unsigned int sizeOperand = isa<MemIntrinsic>(intrinsic) ? 2 : 0;
+      auto *size = cast<ConstantInt>(intrinsic->getArgOperand(sizeOperand));
+      if (size->isMinusOne()) {
+        continue; // lifetime of unknown size
+      }
+      intrinsic->setArgOperand(sizeOperand,
+                               ConstantInt::get(size->getType(), rescale(size->getZExtValue())));
+    }
+
+    for (auto *gepInst : geps) {
+      auto *base = getNewPointer(gepInst->getPointerOperand(), gepInst);
+      SmallVector<Value *> newIndices(gepInst->indices());
+      if (newIndices.size() >= 2) {
+        newIndices[1] = ConstantInt::get(int32Ty, newElement(newIndices[1]));
+      }
+      auto *newInst = GetElementPtrInst::Create(padded.type, base, newIndices, "", gepInst);
+      newInst->setIsInBounds(gepInst->isInBounds());
+      Value *replacement = newInst;
+      if (newIndices.size() < 2) {
+        replacement = new BitCastInst(newInst, gepInst->getType(), "", gepInst);
+      }
+      replacement->takeName(gepInst);
+      gepInst->replaceAllUsesWith(replacement);
+      gepInst->eraseFromParent();
+    }
+
+    for (auto *castInst : firstFieldCasts) {
+      auto *base = getNewPointer(castInst->getOperand(0), castInst);
+      Value *indices[] = {
+        ConstantInt::get(Type::getInt64Ty(M.getContext()), 0),
+        ConstantInt::get(int32Ty, padded.newElementByOldElement[0]),
+      };
+      auto *newInst = GetElementPtrInst::CreateInBounds(padded.type, base, indices, "", castInst);
+      newInst->takeName(castInst);
+      castInst->replaceAllUsesWith(newInst);
+      castInst->eraseFromParent();
+    }
+
+    for (auto &handle : constExprs) {
+      auto *constExpr = dyn_cast_or_null<ConstantExpr>(handle);
+      if (!constExpr || constExpr->use_empty() || !isOldPointer(constExpr->getOperand(0)->getType())) {
+        continue;
+      }
+      auto *base = cast<Constant>(getNewPointer(constExpr->getOperand(0), nullptr));
+      Constant *replacement;
+      if (constExpr->getOpcode() == Instruction::GetElementPtr) {
+        auto *gep = cast<GEPOperator>(constExpr);
+        SmallVector<Constant *> newIndices;
+        for (auto &index : gep->indices()) {
+          newIndices.push_back(cast<Constant>(index));
+        }
+        if (newIndices.size() >= 2) {
+          newIndices[1] = ConstantInt::get(int32Ty, newElement(newIndices[1]));
+        }
+        replacement = ConstantExpr::getGetElementPtr(padded.type, base, newIndices,
+                                                     gep->isInBounds());
+        if (newIndices.size() < 2) {
+          replacement = ConstantExpr::getBitCast(replacement, constExpr->getType());
+        }
+      } else {
+        Constant *indices[] = {
+          ConstantInt::get(Type::getInt64Ty(M.getContext()), 0),
+          ConstantInt::get(int32Ty, padded.newElementByOldElement[0]),
+        };
+        replacement = ConstantExpr::getInBoundsGetElementPtr(padded.type, base, indices);
+      }
+      constExpr->replaceAllUsesWith(replacement);
+    }
+
+    for (auto *globalVar : globals) {
+      auto *newGlobalVar = cast<GlobalVariable>(newStorage[globalVar]);
+      globalVar->removeDeadConstantUsers();
+      globalVar->replaceAllUsesWith(ConstantExpr::getBitCast(newGlobalVar, globalVar->getType()));
+      newGlobalVar->takeName(globalVar);
+      globalVar->eraseFromParent();
+    }
+    for (auto *alloca : allocas) {
+      auto *newAlloca = cast<AllocaInst>(newStorage[alloca]);
+      auto *castInst = new BitCastInst(newAlloca, alloca->getType(), "", alloca);
+      castInst->takeName(alloca);
+      alloca->replaceAllUsesWith(castInst);
+      alloca->eraseFromParent();
+    }
+
+    errs() << "Padded struct type " << oldType->getName() << " (" << globals.size()
+           << " globals, " << allocas.size() << " allocas, " << allocations.size()
+           << " heap allocations): " << oldSize << " -> " << dataLayout.getTypeAllocSize(padded.type)
+           << " bytes\n";
+  }
+
+private:
+  Module &M;
+  StructType *oldType;
+  PaddedStruct &padded;
+  uint64_t oldSize;
+  uint64_t newSize;
+
+  SmallVector<GlobalVariable *> globals;
+  SmallVector<AllocaInst *> allocas;
+  SmallVector<GetElementPtrInst *> geps;
+  SmallVector<BitCastInst *> firstFieldCasts;
+  SmallVector<WeakTrackingVH> constExprs; // rewriting one may recreate another
+  std::set<CallBase *> allocations;
+  std::set<CallBase *> deallocations;
+  std::set<IntrinsicInst *> sizedIntrinsics;
+  std::set<const Constant *> scannedConstants;
+  std::unordered_map<Value *, Value *> newStorage;
+
+  bool fail(const char *reason) {
+    errs() << "Unable to pad struct type " << oldType->getName() << " - " << reason << '\n';
+    return false;
+  }
+
+  bool isOldPointer(const Type *type) const {
+    return type->isPointerTy() && !cast<PointerType>(type)->isOpaque() &&
+           type->getPointerElementType() == oldType;
+  }
+
+  static bool isOpaquePointer(const Type *type) {
+    return type->isPointerTy() && cast<PointerType>(type)->isOpaque();
+  }
+
+  bool isFirstFieldPointer(const Type *type) const {
+    return type->isPointerTy() && !cast<PointerType>(type)->isOpaque() &&
+           oldType->getNumElements() > 0 &&
+           type->getPointerElementType() == oldType->getElementType(0);
+  }
+
+  uint64_t rescale(uint64_t size) const {
+    assert(size % oldSize == 0 && "Size is not a whole number of instances");
+    return size / oldSize * newSize;
+  }
+
+  unsigned int newElement(const Value *index) {
+    auto oldElement = static_cast<unsigned int>(cast<ConstantInt>(index)->getZExtValue());
+    return padded.newElementByOldElement[oldElement];
+  }
+
+  // Returns a pointer to the padded type that addresses the same instance as
+  // oldPtr, inserting a bitcast before insertBefore if needed.
+  Value *getNewPointer(Value *oldPtr, Instruction *insertBefore) {
+    auto *newPtrType = padded.type->getPointerTo(oldPtr->getType()->getPointerAddressSpace());
+    auto it = newStorage.find(oldPtr);
+    if (it != newStorage.end()) {
+      return it->second;
+    }
+    if (auto *castOp = dyn_cast<BitCastOperator>(oldPtr)) {
+      if (castOp->getOperand(0)->getType() == newPtrType) {
+        return castOp->getOperand(0);
+      }
+    }
+    if (auto *constant = dyn_cast<Constant>(oldPtr)) {
+      return ConstantExpr::getBitCast(constant, newPtrType);
+    }
+    return new BitCastInst(oldPtr, newPtrType, "", insertBefore);
+  }
+
+  bool isRescalableSize(const Value *size, bool allowUnknown = false) const {
+    auto *constSize = dyn_cast<ConstantInt>(size);
+    if (!constSize) {
+      return false;
+    }
+    if (constSize->isMinusOne()) {
+      return allowUnknown;
+    }
+    return constSize->getZExtValue() % oldSize == 0;
+  }
+
+  // Whether ptr is a raw (i8*) pointer known to address whole instances of the
+  // struct, so that copying or clearing them can be rescaled.
+  bool isRawInstancePointer(const Value *ptr) const {
+    ptr = ptr->stripPointerCasts();
+    if (isOldPointer(ptr->getType())) {
+      return true;
+    }
+    auto *call = dyn_cast<CallBase>(ptr);
+    return call && isAllocationFunction(call->getCalledFunction());
+  }
+
+  // Whether a pointer to the first field is only used to load and store that
+  // field, directly or through GEPs into it. Anything else, such as offsets,
+  // calls or memory intrinsics, may reach the fields after it, which move.
+  bool onlyAddressesFirstField(const Value *ptr) const {
+    for (auto *user : ptr->users()) {
+      if (auto *load = dyn_cast<LoadInst>(user)) {
+        if (load->getPointerOperand() != ptr) {
+          return false;
+        }
+      } else if (auto *store = dyn_cast<StoreInst>(user)) {
+        if (store->getPointerOperand() != ptr || store->getValueOperand() == ptr) {
+          return false;
+        }
+      } else if (auto *gep = dyn_cast<GEPOperator>(user)) {
+        auto *first = dyn_cast<ConstantInt>(gep->idx_begin()->get());
+        if (gep->getPointerOperand() != ptr || !first || !first->isZero() ||
+            !onlyAddressesFirstField(gep)) {
+          return false;
+        }
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Checks the users of a raw pointer to instances of the struct, recording
+  // the sizes that need to be rescaled and the deallocations that need to
+  // match the aligned allocations.
+  bool checkRawUsers(Value *raw, std::set<IntrinsicInst *> &sizes,
+                     std::set<CallBase *> &frees) const {
+    for (auto *user : raw->users()) {
+      if (auto *memIntrinsic = dyn_cast<MemIntrinsic>(user)) {
+        if (!isRescalableSize(memIntrinsic->getLength())) {
+          return false;
+        }
+        if (auto *transfer = dyn_cast<MemTransferInst>(memIntrinsic)) {
+          if (!isRawInstancePointer(transfer->getRawDest()) ||
+              !isRawInstancePointer(transfer->getRawSource())) {
+            return false;
+          }
+        }
+        sizes.insert(memIntrinsic);
+      } else if (auto *intrinsic = dyn_cast<IntrinsicInst>(user)) {
+        if (!intrinsic->isLifetimeStartOrEnd() ||
+            !isRescalableSize(intrinsic->getArgOperand(0), true)) {
+          return false;
+        }
+        sizes.insert(intrinsic);
+      } else if (auto *call = dyn_cast<CallBase>(user)) {
+        if (!isDeallocationFunction(call->getCalledFunction()) || call->getArgOperand(0) != raw ||
+            (call->arg_size() > 1 && !isRescalableSize(call->getArgOperand(1)))) {
+          return false;
+        }
+        frees.insert(call);
+      } else if (auto *castInst = dyn_cast<BitCastInst>(user)) {
+        if (!isOldPointer(castInst->getType())) {
+          return false;
+        }
+      } else if (!isa<ICmpInst>(user)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool checkSignature(Function &F) {
+    SmallVector<Type *> types(F.getFunctionType()->param_begin(),
+                              F.getFunctionType()->param_end());
+    types.push_back(F.getReturnType());
+    for (auto *type : types) {
+      if (containsType(type, oldType)) {
+        return fail("passed by value");
+      }
+      if (isOldPointer(type) && F.isDeclaration()) {
+        return fail("pointer passed to or returned by external function");
+      }
+      if (isOldPointer(type) && !F.hasLocalLinkage() && !assumeWholeProgram) {
+        return fail("pointer passed to externally visible function");
+      }
+    }
+    for (unsigned int i = 0; i < F.arg_size(); ++i) {
+      if (isOldPointer(F.getArg(i)->getType()) &&
+          (F.hasParamAttribute(i, Attribute::ByVal) ||
+           F.hasParamAttribute(i, Attribute::StructRet) ||
+           F.hasParamAttribute(i, Attribute::InAlloca) ||
+           F.hasParamAttribute(i, Attribute::Preallocated))) {
+        return fail("pointer passed with a by-value ABI attribute");
+      }
+    }
+    return true;
+  }
+
+  bool scanCall(CallBase &call) {
+    auto *callee = call.getCalledFunction();
+    if (isOldPointer(call.getType())) {
+      if (!callee) {
+        return fail("pointer returned by indirect call");
+      }
+      if (callee->isDeclaration()) {
+        return fail("pointer returned by external function");
+      }
+    }
+    for (auto &arg : call.args()) {
+      if (!isOldPointer(arg->getType())) {
+        continue;
+      }
+      if (isDeallocationFunction(callee)) {
+        continue;
+      }
+      if (!callee) {
+        return fail("pointer passed to indirect call");
+      }
+      if (callee->isDeclaration()) {
+        return fail("pointer passed to external function");
+      }
+      if (call.isByValArgument(call.getArgOperandNo(&arg)) ||
+          call.paramHasAttr(call.getArgOperandNo(&arg), Attribute::StructRet)) {
+        return fail("pointer passed with a by-value ABI attribute");
+      }
+    }
+    return true;
+  }
+
+  bool scanInstruction(Instruction &I) {
+    if (auto *alloca = dyn_cast<AllocaInst>(&I)) {
+      if (alloca->getAllocatedType() == oldType) {
+        if (isOpaquePointer(alloca->getType())) {
+          return fail("opaque pointers");
+        }
+        allocas.push_back(alloca);
+      } else if (containsType(alloca->getAllocatedType(), oldType)) {
+        return fail("nested in an alloca of another type");
+      }
+    } else if (auto *gepInst = dyn_cast<GetElementPtrInst>(&I)) {
+      if (gepInst->getSourceElementType() == oldType) {
+        if (gepInst->getType()->isVectorTy()) {
+          return fail("used in vector GetElementPtr instruction");
+        }
+        if (isOpaquePointer(gepInst->getPointerOperandType())) {
+          return fail("opaque pointers");
+        }
+        geps.push_back(gepInst);
+      } else if (containsType(gepInst->getSourceElementType(), oldType)) {
+        return fail("nested in GetElementPtr of another type");
+      }
+    } else if (auto *castInst = dyn_cast<BitCastInst>(&I)) {
+      if (isOldPointer(castInst->getSrcTy())) {
+        std::set<IntrinsicInst *> sizes;
+        std::set<CallBase *> frees;
+        if (checkRawUsers(castInst, sizes, frees)) {
+          sizedIntrinsics.insert(sizes.begin(), sizes.end());
+          deallocations.insert(frees.begin(), frees.end());
+        } else if (isFirstFieldPointer(castInst->getDestTy())) {
+          if (!onlyAddressesFirstField(castInst)) {
+            return fail("offset from pointer to first field");
+          }
+          firstFieldCasts.push_back(castInst);
+        } else {
+          return fail("pointer cast to unrelated type");
+        }
+      } else if (isOldPointer(castInst->getDestTy())) {
+        auto *call = dyn_cast<CallBase>(castInst->getOperand(0));
+        if (!call || !isAllocationFunction(call->getCalledFunction())) {
+          return fail("pointer cast from unknown memory");
+        }
+        std::set<IntrinsicInst *> sizes;
+        std::set<CallBase *> frees;
+        if (!isRescalableSize(call->getArgOperand(0)) || !checkRawUsers(call, sizes, frees)) {
+          return fail("heap allocation of unknown size");
+        }
+        allocations.insert(call);
+        sizedIntrinsics.insert(sizes.begin(), sizes.end());
+        deallocations.insert(frees.begin(), frees.end());
+      }
+    } else if (isa<PtrToIntInst>(&I) || isa<AddrSpaceCastInst>(&I)) {
+      if (isOldPointer(I.getOperand(0)->getType())) {
+        return fail("pointer converted to integer or other address space");
+      }
+    } else if (isa<IntToPtrInst>(&I) && isOldPointer(I.getType())) {
+      return fail("pointer created from integer");
+    } else if (auto *call = dyn_cast<CallBase>(&I)) {
+      if (!scanCall(*call)) {
+        return false;
+      }
+    }
+
+    if (containsType(I.getType(), oldType)) {
+      return fail("used by value");
+    }
+    for (auto &operand : I.operands()) {
+      if (containsType(operand->getType(), oldType)) {
+        return fail("used by value");
+      }
+      if (auto *constant = dyn_cast<Constant>(operand)) {
+        if (!scanConstant(constant)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  bool scanConstant(const Constant *constant) {
+    if (isa<GlobalValue>(constant) || !scannedConstants.insert(constant).second) {
+      return true;
+    }
+    if (auto *constExpr = dyn_cast<ConstantExpr>(constant)) {
+      auto *mutableExpr = const_cast<ConstantExpr *>(constExpr);
+      switch (constExpr->getOpcode()) {
+        case Instruction::GetElementPtr: {
+          auto *sourceType = cast<GEPOperator>(constExpr)->getSourceElementType();
+          if (sourceType == oldType) {
+            if (isOpaquePointer(constExpr->getOperand(0)->getType())) {
+              return fail("opaque pointers");
+            }
+            constExprs.push_back(mutableExpr);
+          } else if (containsType(sourceType, oldType)) {
+            return fail("nested in GetElementPtr constant expression of another type");
+          }
+          break;
+        }
+
+        case Instruction::BitCast:
+          if (isOldPointer(constExpr->getOperand(0)->getType())) {
+            if (!isFirstFieldPointer(constExpr->getType())) {
+              return fail("pointer cast to unrelated type in constant expression");
+            }
+            if (!onlyAddressesFirstField(constExpr)) {
+              return fail("offset from pointer to first field in constant expression");
+            }
+            constExprs.push_back(mutableExpr);
+          } else if (isOldPointer(constExpr->getType())) {
+            return fail("pointer cast from unknown memory in constant expression");
+          }
+          break;
+
+        default:
+          for (auto &operand : constExpr->operands()) {
+            if (isOldPointer(operand->getType())) {
+              return fail("used in unfixable constant expression");
+            }
+          }
+          break;
+      }
+    }
+    for (auto &operand : constant->operands()) {
+      if (!scanConstant(cast<Constant>(operand))) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+}
+
+// Whether a constant (transitively) feeds into one of LLVM's own globals, such
+// as llvm.used, which must refer to globals directly.
+static bool isUsedByLLVMGlobal(const Constant *constant) {
+  for (auto *user : constant->users()) {
+    if (auto *globalVar = dyn_cast<GlobalVariable>(user)) {
+      if (globalVar->getName().startswith("llvm.")) {
+        return true;
+      }
+    } else if (auto *constUser = dyn_cast<Constant>(user)) {
+      if (isUsedByLLVMGlobal(constUser)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Returns the alignment a global needs within a packed cache line, if it can
+// be moved into one at all.
+static Optional<Align> getPackingAlign(const DataLayout &dataLayout,
+                                       const GlobalVariable *globalVar) {
+  if (!globalVar->hasInitializer() || globalVar->isConstant() ||
+      globalVar->isThreadLocal() || globalVar->isExternallyInitialized() ||
+      globalVar->hasSection() || globalVar->hasComdat() ||
+      globalVar->getAddressSpace() != 0 || isUsedByLLVMGlobal(globalVar)) {
+    return None;
+  }
+  if (!GlobalValue::isLocalLinkage(globalVar->getLinkage()) && !assumeWholeProgram) {
+    return None;
+  }
+  auto align = globalVar->getAlign().getValueOr(
+    dataLayout.getABITypeAlign(globalVar->getValueType()));
+  if (align.value() > cacheLineSize ||
+      dataLayout.getTypeAllocSize(globalVar->getValueType()) >= cacheLineSize) {
+    return None;
+  }
+  return align;
+}
+
+// Replaces a group of small globals with a single cache-line-aligned global
+// holding all of them, padded to a whole cache line.
+static void packGlobals(Module &M, const std::vector<GlobalVariable *> &globalVars) {
+  auto &dataLayout = M.getDataLayout();
+  auto &context = M.getContext();
+  auto *int8Ty = Type::getInt8Ty(context);
+  auto *int32Ty = Type::getInt32Ty(context);
+
+  // The struct is packed, with explicit padding to honor each global's
+  // alignment.
+  std::vector<Type *> elementTypes;
+  std::vector<Constant *> initializers;
+  std::vector<unsigned int> elementIndices;
+  uint64_t size = 0;
+  auto addPadding = [&](uint64_t newSize) {
+    if (newSize > size) {
+      auto *paddingType = ArrayType::get(int8Ty, newSize - size);
+      elementTypes.push_back(paddingType);
+      initializers.push_back(Constant::getNullValue(paddingType));
+      size = newSize;
+    }
+  };
+  for (auto *globalVar : globalVars) {
+    addPadding(alignTo(size, *getPackingAlign(dataLayout, globalVar)));
+    elementIndices.push_back(elementTypes.size());
+    elementTypes.push_back(globalVar->getValueType());
+    initializers.push_back(globalVar->getInitializer());
+    size += dataLayout.getTypeAllocSize(globalVar->getValueType());
+  }
+  addPadding(alignTo(size, cacheLineSize));
+
+  auto *packedType = StructType::get(context, elementTypes, true);
+  auto *packedGlobalVar = new GlobalVariable(
+    M,
+    packedType,
+    false,
+    GlobalValue::InternalLinkage,
+    ConstantStruct::get(packedType, initializers),
+    "fs.packed"
+  );
+  packedGlobalVar->setAlignment(Align(cacheLineSize));
+
+  for (size_t i = 0; i < globalVars.size(); ++i) {
+    auto *globalVar = globalVars[i];
+    errs() << "Packing " << globalVar->getName() << " into " << packedGlobalVar->getName() << '\n';
+    auto *replacement = ConstantExpr::getInBoundsGetElementPtr(
+      packedType,
+      packedGlobalVar,
+      ArrayRef<Constant *>{
+        ConstantInt::get(int32Ty, 0),
+        ConstantInt::get(int32Ty, elementIndices[i])
+      }
+    );
+    globalVar->replaceAllUsesWith(replacement);
+    globalVar->eraseFromParent();
+  }
+}
+
+// Returns the access signature of a global, which all globals sharing its
+// cache lines must have in common. Returns None for globals that several
+// threads wrote, or without thread information, which need lines of their own.
+static Optional<AccessSignature> getPackingSignature(
+    const std::map<uint64_t, ThreadAccesses> &accesses) {
+  std::set<uint64_t> readers, writers;
+  for (auto &offset : accesses) {
+    for (auto &thread : offset.second) {
+      (thread.second.written ? writers : readers).insert(thread.first);
+    }
+  }
+  if (writers.size() > 1) {
+    return None;
+  }
+  return getAccessSignature(writers, readers);
+}
+
+// Lays out globals that falsely share cache lines with other globals. Globals
+// written by the same single thread and read by the same other threads are
+// packed together into as few cache lines as possible, as long as no two
+// globals in a line conflicted with each other; their conflicts may have been
+// too rare to be recorded, so globals accessed by different threads are never
+// packed together. Read-only globals join the globals of their only reader, or
+// each other. The remaining globals are each aligned to their own cache line.
+static bool fixConflictingGlobals(
+    Module &M,
+    const std::set<std::string> &names,
+    const std::set<std::pair<std::string, std::string>> &conflictingNames,
+    const std::unordered_map<std::string, std::map<uint64_t, ThreadAccesses>> &accesses) {
+  auto &dataLayout = M.getDataLayout();
+  bool changed = false;
+
+  // access signature -> globals with that signature
+  std::map<AccessSignature, std::vector<GlobalVariable *>> groups;
+  for (auto &name : names) {
+    auto *globalVar = M.getGlobalVariable(name, true);
+    if (!globalVar) {
+      continue;
+    }
+    auto globalAccesses = accesses.find(name);
+    Optional<AccessSignature> signature;
+    if (globalAccesses != accesses.end()) {
+      signature = getPackingSignature(globalAccesses->second);
+    }
+    if (enableGlobalPacking && signature && getPackingAlign(dataLayout, globalVar)) {
+      groups[*signature].push_back(globalVar);
+    } else {
+      errs() << "Aligning " << name << " to cache boundary\n";
+      globalVar->setAlignment(Align(cacheLineSize));
+      changed = true;
+    }
+  }
+
+  for (auto &group : groups) {
+    auto &globalVars = group.second;
+    std::stable_sort(globalVars.begin(), globalVars.end(), [&](auto *g1, auto *g2) {
+      return dataLayout.getTypeAllocSize(g1->getValueType()) >
+             dataLayout.getTypeAllocSize(g2->getValueType());
+    });
+
+    // First fit decreasing into cache-line-sized buckets
+    std::vector<std::vector<GlobalVariable *>> buckets;
+    std::vector<uint64_t> bucketSizes;
+    for (auto *globalVar : globalVars) {
+      uint64_t size = dataLayout.getTypeAllocSize(globalVar->getValueType());
+      auto align = *getPackingAlign(dataLayout, globalVar);
+      size_t i = 0;
+      for (; i < buckets.size(); ++i) {
+        if (alignTo(bucketSizes[i], align) + size > cacheLineSize) {
+          continue;
+        }
+        bool conflicts = std::any_of(buckets[i].begin(), buckets[i].end(), [&](auto *other) {
+          return conflictingNames.count({globalVar->getName().str(), other->getName().str()}) ||
+                 conflictingNames.count({other->getName().str(), globalVar->getName().str()});
+        });
+        if (!conflicts) {
+          break;
+        }
+      }
+      if (i == buckets.size()) {
+        buckets.emplace_back();
+        bucketSizes.push_back(0);
+      }
+      buckets[i].push_back(globalVar);
+      bucketSizes[i] = alignTo(bucketSizes[i], align) + size;
+    }
+
+    for (auto &bucket : buckets) {
+      if (bucket.size() == 1) {
+        errs() << "Aligning " << bucket.front()->getName() << " to cache boundary\n";
+        bucket.front()->setAlignment(Align(cacheLineSize));
+      } else {
+        packGlobals(M, bucket);
+      }
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+namespace{
+struct Fix583 : public ModulePass {
+  static char ID;
+
+  static const std::string threadsFile;
+  static const std::string affinityFile;
+
+  // Reads a binary profile, as described in pin/MapAddr/ProfileFormat.h.
+  // Returns false if it is malformed.
+  static bool readBinaryProfile(StringRef data, Profile &profile) {
+    using namespace support::endian;
+    auto fail = [](const char *reason) {
+      errs() << "Unable to read binary profile - " << reason << '\n';
+      return false;
+    };
+    if (data.size() < profile_v1_header_size) {
+      return fail("truncated header");
+    }
+    const char *header = data.data();
+    uint32_t version = read32le(header + 8);
+    if (version < 1 || version > profile_version) {
+      return fail("unsupported version");
+    }
+    // The run length in version 2 headers is not needed here.
+    uint64_t headerSize = version == 1 ? profile_v1_header_size : profile_header_size;
+    if (data.size() < headerSize) {
+      return fail("truncated header");
+    }
+    uint64_t numStrings = read32le(header + 16);
+    uint64_t numConflicts = read32le(header + 20);
+    uint64_t numThreadAccesses = read32le(header + 24);
+    uint64_t stringDataSize = read32le(header + 28);
+
+    uint64_t stringEntriesOffset = headerSize;
+    uint64_t stringDataOffset = stringEntriesOffset + numStrings * profile_string_entry_size;
+    uint64_t conflictsOffset = stringDataOffset + alignTo(stringDataSize, 8);
+    uint64_t conflictSize = version < 3 ? profile_v2_conflict_size : profile_conflict_size;
+    uint64_t threadAccessSize = version < 4 ? profile_v3_thread_access_size : profile_thread_access_size;
+    uint64_t threadAccessesOffset = conflictsOffset + numConflicts * conflictSize;
+    uint64_t endOffset = threadAccessesOffset + numThreadAccesses * threadAccessSize;
+    if (data.size() < endOffset) {
+      return fail("truncated data");
+    }
+
+    std::vector<StringRef> strings;
+    strings.reserve(numStrings);
+    for (uint64_t i = 0; i < numStrings; ++i) {
+      const char *entry = data.data() + stringEntriesOffset + i * profile_string_entry_size;
+      uint64_t offset = read32le(entry);
+      uint64_t length = read32le(entry + 4);
+      if (offset + length > stringDataSize) {
+        return fail("string out of bounds");
+      }
+      strings.push_back(data.substr(stringDataOffset + offset, length));
+    }
+    auto getString = [&](const char *field, StringRef &str) {
+      uint32_t index = read32le(field);
+      if (index >= strings.size()) {
+        return false;
+      }
+      str = strings[index];
+      return true;
+    };
+
+    profile.conflicts.reserve(numConflicts);
+    for (uint64_t i = 0; i < numConflicts; ++i) {
+      const char *record = data.data() + conflictsOffset + i * conflictSize;
+      StringRef name1, name2;
+      if (!getString(record, name1) || !getString(record + 4, name2)) {
+        return fail("conflict name out of bounds");
+      }
+      // The relative error at record + 48 is not used.
+      profile.conflicts.push_back(Conflict{
+        {name1.str(), static_cast<size_t>(read64le(record + 8)), static_cast<size_t>(read64le(record + 16))},
+        {name2.str(), static_cast<size_t>(read64le(record + 24)), static_cast<size_t>(read64le(record + 32))},
+        read64le(record + 40),
+        version < 3 ? 0.0 : bit_cast<double>(read64le(record + 56))
+      });
+    }
+
+    for (uint64_t i = 0; i < numThreadAccesses; ++i) {
+      const char *record = data.data() + threadAccessesOffset + i * threadAccessSize;
+      StringRef name;
+      if (!getString(record, name)) {
+        return fail("thread access name out of bounds");
+      }
+      ThreadAccess access;
+      access.written = read32le(record + 4) != 0;
+      if (version >= 4) {
+        access.reads = read64le(record + 24);
+        access.writes = read64le(record + 32);
+      }
+      profile.accesses[name.str()][read64le(record + 8)][read64le(record + 16)].add(access);
+    }
+    return true;
+  }
+
+  // Each line holds one conflict. Conflicts from sampled profiles have an
+  // extra column with the relative error of the priority, which is ignored.
+  static void readTextConflicts(const MemoryBuffer &buffer, Profile &profile) {
+    for (line_iterator line(buffer, true, '#'); !line.is_at_eof(); ++line) {
+      std::istringstream lineIn(line->str());
+      Conflict conflict;
+      if (lineIn >> conflict) {
+        profile.conflicts.push_back(std::move(conflict));
+      }
+    }
+  }
+
+  // Reads the threads that accessed each conflicting global, and whether they
+  // wrote it. The file is optional; globals without thread information are
+  // never packed.
+  static void readTextThreadAccesses(Profile &profile) {
+    std::ifstream in(threadsFile);
+
+    std::string name, rw;
+    size_t offset;
+    uint64_t thread;
+    while (in >> name >> offset >> thread >> rw) {
+      bool &written = profile.accesses[name][offset][thread].written;
+      written = written || rw == "W";
+    }
+  }
+
+  // Reads how often each thread read and wrote each conflicting global, from
+  // "name offset size thread reads writes" lines. The file is optional too.
+  static void readTextAccessCounts(Profile &profile) {
+    std::ifstream in(affinityFile);
+
+    std::string name;
+    size_t offset, size;
+    uint64_t thread;
+    ThreadAccess access;
+    while (in >> name >> offset >> size >> thread >> access.reads >> access.writes) {
+      access.written = access.writes > 0;
+      profile.accesses[name][offset][thread].add(access);
+    }
+  }
+
+  // The file is mapped rather than read when it is large enough.
+  Profile readProfile() {
+    Profile profile;
+    auto buffer = MemoryBuffer::getFile(profilePath, /*IsText=*/false,
+                                        /*RequiresNullTerminator=*/false);
+    if (!buffer) {
+      errs() << "Unable to read profile " << profilePath << " - "
+             << buffer.getError().message() << '\n';
+      return profile;
+    }
+
+    StringRef data = (*buffer)->getBuffer();
+    if (data.startswith(StringRef(profile_magic, sizeof(profile_magic)))) {
+      if (!readBinaryProfile(data, profile)) {
+        return Profile();
+      }
+    } else {
+      readTextConflicts(**buffer, profile);
+      readTextThreadAccesses(profile);
+      readTextAccessCounts(profile);
+    }
+    return profile;
+  }
+
+  Fix583() : ModulePass(ID) {}
+
+  bool runOnModule(Module &M) override {
+    bool changed = false;
+    auto profile = readProfile();
+    auto &conflicts = profile.conflicts;
+    std::sort(conflicts.begin(), conflicts.end(), [](auto &c1, auto &c2) {
+      return c1.priority > c2.priority;
+    });
+
+    auto &dataLayout = M.getDataLayout();
+
+    // Adds how each thread accessed the elements of a struct global.
+    auto addProfiledAccesses = [&](ElementConflicts &elementConflicts,
+                                   const StructLayout *layout,
+                                   const GlobalVariable *globalVar) {
+      auto accesses = profile.accesses.find(globalVar->getName().str());
+      if (accesses == profile.accesses.end()) {
+        return;
+      }
+      for (auto &offset : accesses->second) {
+        elementConflicts.addAccesses(layout, offset.first, offset.second);
+      }
+    };
+
+    // struct type -> global -> pairs of conflicting offsets within the global
+    std::unordered_map<StructType *,
+      std::unordered_map<GlobalVariable *, std::set<std::pair<size_t, size_t>>>> structAccesses;
+
+    // integer globals that may be privatized into thread-local copies
+    std::set<GlobalVariable *> privatizationCandidates;
+
+    // array global -> total priority of conflicts between different elements
+    std::unordered_map<GlobalVariable *, uint64_t> arrayPriorities;
+
+    // globals that conflict with other globals, and the conflicting pairs
+    std::set<std::string> crossConflictingNames;
+    std::set<std::pair<std::string, std::string>> crossConflicts;
+
+    Optional<uint64_t> priorityThreshold;
+
+    for (auto &conflict : conflicts) {
+      if (!priorityThreshold) {
+        priorityThreshold = conflict.priority / 1000;
+      }
+      if (conflict.priority < *priorityThreshold) {
+        break;
+      }
+      auto *global1 = M.getGlobalVariable(conflict.entry1.variableName, true);
+      auto *global2 = M.getGlobalVariable(conflict.entry2.variableName, true);
+      if (!global1) {
+        errs() << "Did not find global with name " << conflict.entry1.variableName << '\n';
+        continue;
+      }
+      if (!global2) {
+        errs() << "Did not find global with name " << conflict.entry2.variableName << '\n';
+        continue;
+      }
+      if (enablePrivatization) {
+        for (auto *global : {global1, global2}) {
+          if (global->getValueType()->isIntegerTy()) {
+            privatizationCandidates.insert(global);
+          }
+        }
+      }
+      if (conflict.trueSharing > maxTrueSharing) {
+        errs() << "Not changing the layout for conflict between " << conflict.entry1.variableName
+               << " and " << conflict.entry2.variableName << " - "
+               << format("%.0f", conflict.trueSharing * 100)
+               << "% of the sharing on its cache line is true sharing\n";
+        continue;
+      }
+      if (conflict.entry1.variableName == conflict.entry2.variableName) {
+        if (auto *type = dyn_cast<StructType>(global1->getValueType())) {
+          if (enableStructPadding && !global1->isDeclaration()) {
+            structAccesses[type][global1].emplace(
+              conflict.entry1.accessOffsetInVariable,
+              conflict.entry2.accessOffsetInVariable);
+          }
+        } else if (auto *type = dyn_cast<ArrayType>(global1->getValueType())) {
+          uint64_t elementSize = dataLayout.getTypeAllocSize(type->getElementType());
+          if (enableArrayStriding && elementSize > 0 &&
+              conflict.entry1.accessOffsetInVariable / elementSize !=
+                conflict.entry2.accessOffsetInVariable / elementSize) {
+            arrayPriorities[global1] += conflict.priority;
+          }
+        }
+      } else {
+        crossConflictingNames.insert(conflict.entry1.variableName);
+        crossConflictingNames.insert(conflict.entry2.variableName);
+        crossConflicts.emplace(conflict.entry1.variableName, conflict.entry2.variableName);
+      }
+    }
+
+    for (auto &pair : structAccesses) {
+      auto *type = pair.first;
+      auto *layout = dataLayout.getStructLayout(type);
+
+      // Pad the type itself if possible, so that every instance is fixed.
+      ElementConflicts typeConflicts;
+      for (auto &pair2 : pair.second) {
+        for (auto &offsets : pair2.second) {
+          typeConflicts.add(layout, offsets);
+        }
+        addProfiledAccesses(typeConflicts, layout, pair2.first);
+      }
+      if (typeConflicts.elements.size() > 1) {
+        errs() << "Found struct type " << type->getName() << " with false sharing in elements ";
+        typeConflicts.print();
+        auto padded = makePaddedStruct(M, dataLayout, type, typeConflicts, true);
+        StructTypeRewriter rewriter(M, type, *padded);
+        if (rewriter.canRewrite()) {
+          rewriter.rewrite();
+          changed = true;
+          continue;
+        }
+      }
+
+      // Otherwise, replace the individual globals that can be replaced.
       for (auto &pair2 : pair.second) {
         auto *globalVar = pair2.first;
-        auto *layout = dataLayout.getStructLayout(type);
-        std::set<unsigned int> conflictingElements;
-        for (size_t offset : pair2.second) {
-          conflictingElements.insert(layout->getElementContainingOffset(offset));
+        if (!GlobalValue::isLocalLinkage(globalVar->getLinkage()) && !assumeWholeProgram) {
+          continue;
+        }
+        ElementConflicts conflicts;
+        for (auto &offsets : pair2.second) {
+          conflicts.add(layout, offsets);
         }
-        if (conflictingElements.size() > 1) {
+        addProfiledAccesses(conflicts, layout, globalVar);
+        if (conflicts.elements.size() > 1) {
           errs() << "Found struct " << globalVar->getName() << " with false sharing in elements ";
-          for (auto idx : conflictingElements) {
-            errs() << idx << ' ';
-          }
-          errs() << '\n';
-          PaddedStruct padded(M, type, layout, conflictingElements);
-          changed = fixGlobalStruct(M, globalVar, padded) || changed;
+          conflicts.print();
+          auto padded = makePaddedStruct(M, dataLayout, type, conflicts);
+          changed = fixGlobalStruct(M, globalVar, *padded) || changed;
         }
       }
     }
+    for (auto *globalVar : privatizationCandidates) {
+      changed = privatizeGlobal(M, globalVar) || changed;
+    }
+
+    for (auto &pair : arrayPriorities) {
+      auto *globalVar = pair.first;
+      if (pair.second < strideMinPriority) {
+        errs() << "Not striding array " << globalVar->getName() << " - total priority "
+               << pair.second << " below threshold\n";
+        continue;
+      }
+      changed = fixGlobalArray(M, globalVar) || changed;
+    }
+
+    // Globals may have been replaced above, so they are looked up by name.
+    changed = fixConflictingGlobals(M, crossConflictingNames, crossConflicts,
+                                    profile.accesses) || changed;
     return changed;
   }
 }; // end of struct Fix583
 }  // end of anonymous namespace
 
 char Fix583::ID = 0;
-const std::string Fix583::inputFile = "mapped_conflicts.out";
+const std::string Fix583::threadsFile = "mapped_threads.out";
+const std::string Fix583::affinityFile = "mapped_affinity.out";
 static RegisterPass<Fix583> X("false-sharing-fix", "Pass to fix false sharing",
                               false /* Only looks at CFG */,
                               false /* Analysis Pass */);
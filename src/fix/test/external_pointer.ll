@@ -0,0 +1,30 @@
+; A struct type is not padded when a pointer to it comes from a function
+; outside the module, which lays the struct out the old way.
+;
+; CONFLICTS: s 0 8 s 8 8 1000
+
+; CHECK: Unable to pad struct type struct.S - pointer returned by external function
+; CHECK-NOT: Padded struct type
+; CHECK-LABEL: define void @useExternal
+; CHECK: getelementptr inbounds %struct.S, %struct.S* %p, i64 0, i32 1
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+%struct.S = type { i64, i64 }
+
+@s = internal global %struct.S zeroinitializer
+
+define void @useExternal() {
+  %p = call %struct.S* @ext()
+  %b = getelementptr inbounds %struct.S, %struct.S* %p, i64 0, i32 1
+  store i64 1, i64* %b
+  ret void
+}
+
+define void @thread1() {
+  store i64 1, i64* getelementptr inbounds (%struct.S, %struct.S* @s, i64 0, i32 0)
+  ret void
+}
+
+declare %struct.S* @ext()
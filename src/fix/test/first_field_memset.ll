@@ -0,0 +1,37 @@
+; A pointer to an i8 first field that is also cleared with a memset over the
+; whole struct and passed to a function may reach the fields after it, so the
+; struct type is not padded.
+;
+; CONFLICTS: t 0 1 t 8 8 1000
+
+; CHECK: Unable to pad struct type struct.T - offset from pointer to first field
+; CHECK-NOT: Padded struct type
+; CHECK-LABEL: define internal void @clear
+; CHECK: call void @llvm.memset.p0i8.i64(i8* %first, i8 0, i64 16, i1 false)
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+%struct.T = type { i8, i64 }
+
+@t = internal global %struct.T zeroinitializer
+
+define internal void @clear(%struct.T* %p) {
+  %first = bitcast %struct.T* %p to i8*
+  call void @llvm.memset.p0i8.i64(i8* %first, i8 0, i64 16, i1 false)
+  call void @use(i8* %first)
+  ret void
+}
+
+define internal void @use(i8* %first) {
+  store i8 1, i8* %first
+  ret void
+}
+
+define void @thread1() {
+  store i8 1, i8* getelementptr inbounds (%struct.T, %struct.T* @t, i64 0, i32 0)
+  call void @clear(%struct.T* @t)
+  ret void
+}
+
+declare void @llvm.memset.p0i8.i64(i8*, i8, i64, i1)
@@ -0,0 +1,34 @@
+; A struct type is not padded when a pointer to its first field is used to
+; reach the fields after it, since padding moves them. Its global is padded
+; on its own instead, and the heap allocation is left alone.
+;
+; CONFLICTS: t 0 1 t 8 8 1000
+
+; CHECK: Unable to pad struct type struct.T - offset from pointer to first field
+; CHECK: Replacing t with new, padded global
+; CHECK-NOT: Padded struct type
+; CHECK-LABEL: define void @byteOffset
+; CHECK: call i8* @_Znwm(i64 16)
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+%struct.T = type { i8, i64 }
+
+@t = internal global %struct.T zeroinitializer
+
+define void @byteOffset() {
+  %raw = call i8* @_Znwm(i64 16)
+  %p = bitcast i8* %raw to %struct.T*
+  %first = bitcast %struct.T* %p to i8*
+  %second = getelementptr inbounds i8, i8* %first, i64 8
+  store i8 1, i8* %second
+  ret void
+}
+
+define void @thread1() {
+  store i8 1, i8* getelementptr inbounds (%struct.T, %struct.T* @t, i64 0, i32 0)
+  ret void
+}
+
+declare i8* @_Znwm(i64)
@@ -0,0 +1,66 @@
+; Padding a struct type rounds it up to whole cache lines and allocates its
+; heap instances on cache line boundaries, so that neighboring objects and
+; array elements do not share lines. Deallocations match the allocations.
+;
+; CONFLICTS: s 0 8 s 8 8 1000
+
+; CHECK: Padded struct type struct.S (1 globals, 0 allocas, 3 heap allocations): 16 -> 128 bytes
+; CHECK: %struct.S{{[.0-9]*}} = type { i64, [56 x i8], i64, [56 x i8] }
+; CHECK-LABEL: define void @newDelete
+; CHECK: call i8* @_ZnwmSt11align_val_t(i64 128, i64 64)
+; CHECK: call void @_ZdlPvSt11align_val_t(i8* {{.*}}, i64 64)
+; CHECK-LABEL: define void @newArrayDelete
+; CHECK: call i8* @_ZnamSt11align_val_t(i64 512, i64 64)
+; CHECK: call void @_ZdaPvmSt11align_val_t(i8* {{.*}}, i64 512, i64 64)
+; CHECK-LABEL: define void @mallocFree
+; CHECK: call i8* @aligned_alloc(i64 64, i64 256)
+; CHECK: call void @free(
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+%struct.S = type { i64, i64 }
+
+@s = internal global %struct.S zeroinitializer
+
+define void @newDelete() {
+  %raw = call i8* @_Znwm(i64 16)
+  %p = bitcast i8* %raw to %struct.S*
+  %b = getelementptr inbounds %struct.S, %struct.S* %p, i64 0, i32 1
+  store i64 1, i64* %b
+  %free = bitcast %struct.S* %p to i8*
+  call void @_ZdlPv(i8* %free)
+  ret void
+}
+
+define void @newArrayDelete() {
+  %raw = call i8* @_Znam(i64 64)
+  %p = bitcast i8* %raw to %struct.S*
+  %third = getelementptr inbounds %struct.S, %struct.S* %p, i64 2
+  %b = getelementptr inbounds %struct.S, %struct.S* %third, i64 0, i32 1
+  store i64 1, i64* %b
+  %free = bitcast %struct.S* %p to i8*
+  call void @_ZdaPvm(i8* %free, i64 64)
+  ret void
+}
+
+define void @mallocFree() {
+  %raw = call i8* @malloc(i64 32)
+  %p = bitcast i8* %raw to %struct.S*
+  %a = getelementptr inbounds %struct.S, %struct.S* %p, i64 1, i32 0
+  store i64 1, i64* %a
+  call void @free(i8* %raw)
+  ret void
+}
+
+define void @thread1() {
+  store i64 1, i64* getelementptr inbounds (%struct.S, %struct.S* @s, i64 0, i32 0)
+  ret void
+}
+
+declare i8* @_Znwm(i64)
+declare i8* @_Znam(i64)
+declare i8* @malloc(i64)
+declare void @_ZdlPv(i8*)
+declare void @_ZdaPvm(i8*, i64)
+declare void @free(i8*)
@@ -0,0 +1,34 @@
+; With opaque pointers the heap allocations, sizes and casts of a struct
+; cannot be told apart from other memory, so its type is not padded: moving
+; its fields would make the GEPs reach past the end of the 16-byte
+; allocation. Its global is padded on its own instead.
+;
+; FIX-ARGS: -opaque-pointers
+; CONFLICTS: s 0 8 s 8 8 1000
+
+; CHECK: Unable to pad struct type struct.S - opaque pointers
+; CHECK-NOT: Padded struct type
+; CHECK-LABEL: define void @newStore
+; CHECK: call ptr @_Znwm(i64 16)
+; CHECK: getelementptr inbounds %struct.S, ptr %p, i64 0, i32 1
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+%struct.S = type { i64, i64 }
+
+@s = internal global %struct.S zeroinitializer
+
+define void @newStore() {
+  %p = call ptr @_Znwm(i64 16)
+  %b = getelementptr inbounds %struct.S, ptr %p, i64 0, i32 1
+  store i64 1, ptr %b
+  ret void
+}
+
+define void @thread1() {
+  store i64 1, ptr @s
+  ret void
+}
+
+declare ptr @_Znwm(i64)
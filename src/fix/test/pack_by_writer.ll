@@ -0,0 +1,59 @@
+; Globals are only packed into a cache line with globals written by the same
+; thread and read by the same other threads. a and b were accessed by the same
+; threads, but written by different ones, so they are not packed together even
+; though no conflict between them was recorded. d is written by thread 1 like
+; a and e, but only a and e are read by thread 2, so d would make thread 2's
+; reads miss; it joins f, which only thread 1 reads, instead.
+;
+; CONFLICTS: a 0 4 c 0 4 1000
+; CONFLICTS: b 0 4 c 0 4 1000
+; CONFLICTS: d 0 4 c 0 4 1000
+; CONFLICTS: e 0 4 c 0 4 1000
+; CONFLICTS: f 0 4 c 0 4 1000
+; THREADS: a 0 1 W
+; THREADS: a 0 2 R
+; THREADS: b 0 1 R
+; THREADS: b 0 2 W
+; THREADS: c 0 3 W
+; THREADS: d 0 1 W
+; THREADS: e 0 1 W
+; THREADS: e 0 2 R
+; THREADS: f 0 1 R
+
+; CHECK-DAG: Packing d into fs.packed{{$}}
+; CHECK-DAG: Packing f into fs.packed{{$}}
+; CHECK-DAG: Packing a into fs.packed.1{{$}}
+; CHECK-DAG: Packing e into fs.packed.1{{$}}
+; CHECK-DAG: Aligning b to cache boundary
+; CHECK-DAG: Aligning c to cache boundary
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+@a = internal global i32 0
+@b = internal global i32 0
+@c = internal global i32 0
+@d = internal global i32 0
+@e = internal global i32 0
+@f = internal global i32 0
+
+define void @thread1() {
+  store i32 1, i32* @a
+  store i32 1, i32* @d
+  store i32 1, i32* @e
+  %b = load i32, i32* @b
+  %f = load i32, i32* @f
+  ret void
+}
+
+define void @thread2() {
+  store i32 2, i32* @b
+  %a = load i32, i32* @a
+  %e = load i32, i32* @e
+  ret void
+}
+
+define void @thread3() {
+  store i32 3, i32* @c
+  ret void
+}
@@ -0,0 +1,49 @@
+; A counter that is only updated with additions is privatized: each thread
+; adds to its own thread-local copy, which is added to the counter when the
+; thread exits, and reads see the counter plus the reading thread's copy.
+;
+; FIX-ARGS: -fs-privatize
+; CONFLICTS: counter 0 8 other 0 8 1000
+; THREADS: counter 0 1 W
+; THREADS: counter 0 2 W
+; THREADS: other 0 1 W
+
+; CHECK: Privatizing counter into thread-local copies (1 updates, 1 reads)
+; CHECK: Unable to privatize other - assigned directly
+; CHECK: @counter.private = internal thread_local global i64 0
+; CHECK-LABEL: define void @count
+; CHECK: call i32 @__cxa_thread_atexit(void (i8*)* @counter.flush
+; CHECK: [[PRIVATE:%[0-9]+]] = load i64, i64* @counter.private
+; CHECK: [[NEXT:%[0-9]+]] = add i64 [[PRIVATE]], %n
+; CHECK: store i64 [[NEXT]], i64* @counter.private
+; CHECK-LABEL: define i64 @read
+; CHECK: %value = load i64, i64* @counter
+; CHECK: [[MINE:%[0-9]+]] = load i64, i64* @counter.private
+; CHECK: [[SUM:%[0-9]+]] = add i64 %value, [[MINE]]
+; CHECK: ret i64 [[SUM]]
+; CHECK-LABEL: define internal void @counter.flush
+; CHECK: atomicrmw add i64* @counter
+; CHECK: store i64 0, i64* @counter.private
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+@counter = internal global i64 0
+@other = internal global i64 0
+
+define void @count(i64 %n) {
+  %value = load i64, i64* @counter
+  %next = add i64 %value, %n
+  store i64 %next, i64* @counter
+  ret void
+}
+
+define i64 @read() {
+  %value = load i64, i64* @counter
+  ret i64 %value
+}
+
+define void @set() {
+  store i64 1, i64* @other
+  ret void
+}
@@ -0,0 +1,34 @@
+; g = g + g doubles the counter rather than adding to it, so it is not
+; privatized; its two loads would otherwise be rewritten as two updates
+; sharing one store.
+;
+; FIX-ARGS: -fs-privatize
+; CONFLICTS: counter 0 8 other 0 8 1000
+; THREADS: counter 0 1 W
+; THREADS: counter 0 2 W
+; THREADS: other 0 1 W
+
+; CHECK: Unable to privatize counter - updated with its own value
+; CHECK-NOT: Privatizing counter
+; CHECK-LABEL: define void @double
+; CHECK: %twice = add i64 %first, %second
+; CHECK: store i64 %twice, i64* @counter
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+@counter = internal global i64 0
+@other = internal global i64 0
+
+define void @double() {
+  %first = load i64, i64* @counter
+  %second = load i64, i64* @counter
+  %twice = add i64 %first, %second
+  store i64 %twice, i64* @counter
+  ret void
+}
+
+define void @set() {
+  store i64 1, i64* @other
+  ret void
+}
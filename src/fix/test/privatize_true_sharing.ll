@@ -0,0 +1,41 @@
+; A counter that threads 1 to 4 all update is truly shared, which padding
+; cannot remove, so its conflict with other does not change the layout. It is
+; still privatized, as thread-local copies remove the true sharing too.
+;
+; FIX-ARGS: -fs-privatize
+; GLOBALS: counter	0x1000000004000	8
+; GLOBALS: other	0x1000000004008	8
+; TRACE: 0x0001000000001000: W 0x0001000000004000  8 1   0
+; TRACE: 0x0001000000001000: W 0x0001000000004000  8 2   0
+; TRACE: 0x0001000000001000: W 0x0001000000004000  8 3   0
+; TRACE: 0x0001000000001000: W 0x0001000000004000  8 4   0
+; TRACE: 0x0001000000001000: W 0x0001000000004000  8 1   0
+; TRACE: 0x0001000000001010: W 0x0001000000004008  8 1   0
+;
+; Threads 2, 3 and 4 each truly share counter with the threads that wrote it
+; before them, 1 + 2 + 3 = 6 pairs; thread 1's repeated write is not compared
+; again. Its write to other falsely shares the line with the counter of
+; threads 2, 3 and 4, 3 pairs. So 6 / 9 = 67% of the sharing is true sharing.
+
+; CHECK: Not changing the layout for conflict between counter and other - 67% of the sharing on its cache line is true sharing
+; CHECK: Privatizing counter into thread-local copies
+; CHECK-NOT: {{Aligning|Packing|Padding}}
+; CHECK: @counter.private = internal thread_local global i64 0
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+@counter = internal global i64 0
+@other = internal global i64 0
+
+define void @count() {
+  %value = load i64, i64* @counter
+  %next = add i64 %value, 1
+  store i64 %next, i64* @counter
+  ret void
+}
+
+define void @set() {
+  store i64 1, i64* @other
+  ret void
+}
@@ -0,0 +1,47 @@
+; flag is written once by thread 1 and then read by both threads ten times,
+; so with the read and write counts of the profile it is reordered as a
+; read-only field rather than with a, which thread 1 writes. b, which thread 2
+; writes, conflicted with a.
+;
+; FIX-ARGS: -fs-reorder-fields -fs-read-mostly=0.1
+; GLOBALS: s	0x1000000004000	24
+; TRACE: 0x0001000000001000: W 0x0001000000004008  8 1   0
+; TRACE: 0x0001000000001010: R 0x0001000000004008  8 1   0
+; TRACE: 0x0001000000001010: R 0x0001000000004008  8 2   0
+; TRACE: 0x0001000000001010: R 0x0001000000004008  8 1   0
+; TRACE: 0x0001000000001010: R 0x0001000000004008  8 2   0
+; TRACE: 0x0001000000001010: R 0x0001000000004008  8 1   0
+; TRACE: 0x0001000000001010: R 0x0001000000004008  8 2   0
+; TRACE: 0x0001000000001010: R 0x0001000000004008  8 1   0
+; TRACE: 0x0001000000001010: R 0x0001000000004008  8 2   0
+; TRACE: 0x0001000000001010: R 0x0001000000004008  8 1   0
+; TRACE: 0x0001000000001010: R 0x0001000000004008  8 2   0
+; TRACE: 0x0001000000001020: W 0x0001000000004000  8 1   0
+; TRACE: 0x0001000000001030: W 0x0001000000004010  8 2   0
+
+; CHECK: Reordering struct.S into 3 cache line clusters
+; CHECK: %struct.S{{[.0-9]*}} = type { i64, [56 x i8], i64, [56 x i8], i64
+; CHECK-LABEL: define void @thread1
+; CHECK: store i64 1, i64* getelementptr inbounds ({{.*}} @s, i64 0, i32 0)
+; CHECK: store i64 1, i64* getelementptr inbounds ({{.*}} @s, i64 0, i32 2)
+; CHECK-LABEL: define void @thread2
+; CHECK: store i64 2, i64* getelementptr inbounds ({{.*}} @s, i64 0, i32 4)
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+%struct.S = type { i64, i64, i64 }
+
+@s = internal global %struct.S zeroinitializer
+
+define void @thread1() {
+  store i64 1, i64* getelementptr inbounds (%struct.S, %struct.S* @s, i64 0, i32 1)
+  store i64 1, i64* getelementptr inbounds (%struct.S, %struct.S* @s, i64 0, i32 0)
+  ret void
+}
+
+define void @thread2() {
+  %r = load i64, i64* getelementptr inbounds (%struct.S, %struct.S* @s, i64 0, i32 1)
+  store i64 2, i64* getelementptr inbounds (%struct.S, %struct.S* @s, i64 0, i32 2)
+  ret void
+}
@@ -0,0 +1,39 @@
+; A read-only field is kept apart from the fields thread 1 writes, although
+; it never conflicted with them, and those are kept apart from the field
+; thread 2 writes.
+;
+; FIX-ARGS: -fs-reorder-fields
+; CONFLICTS: s 0 8 s 8 8 1000
+; THREADS: s 0 1 W
+; THREADS: s 8 2 W
+; THREADS: s 16 1 R
+; THREADS: s 16 2 R
+; THREADS: s 24 1 W
+
+; CHECK: Reordering struct.S into 3 cache line clusters
+; CHECK: %struct.S{{[.0-9]*}} = type { i64, [56 x i8], i64, i64, [48 x i8], i64
+; CHECK-LABEL: define void @thread1
+; CHECK: store i64 1, i64* getelementptr inbounds ({{.*}} @s, i64 0, i32 2)
+; CHECK: store i64 1, i64* getelementptr inbounds ({{.*}} @s, i64 0, i32 3)
+; CHECK-LABEL: define void @thread2
+; CHECK: store i64 2, i64* getelementptr inbounds ({{.*}} @s, i64 0, i32 5)
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+%struct.S = type { i64, i64, i64, i64 }
+
+@s = internal global %struct.S zeroinitializer
+
+define void @thread1() {
+  store i64 1, i64* getelementptr inbounds (%struct.S, %struct.S* @s, i64 0, i32 0)
+  store i64 1, i64* getelementptr inbounds (%struct.S, %struct.S* @s, i64 0, i32 3)
+  %r = load i64, i64* getelementptr inbounds (%struct.S, %struct.S* @s, i64 0, i32 2)
+  ret void
+}
+
+define void @thread2() {
+  store i64 2, i64* getelementptr inbounds (%struct.S, %struct.S* @s, i64 0, i32 1)
+  %r = load i64, i64* getelementptr inbounds (%struct.S, %struct.S* @s, i64 0, i32 2)
+  ret void
+}
@@ -0,0 +1,47 @@
+#!/bin/bash
+# Runs the fix pass on a test module and checks the pass's messages and the
+# rewritten module with FileCheck, using the CHECK lines of the test. The
+# profile is given in comments of the test:
+#   ; FIX-ARGS: <options of the fix pass>
+#   ; CONFLICTS: <line of mapped_conflicts.out>
+#   ; THREADS: <line of mapped_threads.out>
+# or, for what only the binary profile records, as a trace that analyze turns
+# into mapped_profile.fsp for the pass to read instead:
+#   ; GLOBALS: <line of fs_globals.txt>
+#   ; TRACE: <line of pinatrace.out>
+#
+# Usage: run_test.sh <opt> <FileCheck> <fix pass plugin> <analyze> <test.ll>
+set -Eeuo pipefail
+
+if [ $# -ne 5 ]; then
+    >&2 echo "Usage: run_test.sh <opt> <FileCheck> <fix pass plugin> <analyze> <test.ll>"
+    exit 1
+fi
+
+OPT=${1}
+FILECHECK=${2}
+PLUGIN=${3}
+ANALYZE=${4}
+TEST="$(cd -- "$(dirname -- "${5}")" && pwd)/$(basename -- "${5}")"
+
+RUN_DIR=$(mktemp -d)
+trap 'rm -rf "${RUN_DIR}"' EXIT
+
+directive() {
+    sed -n "s/^; ${1}: //p" "${TEST}"
+}
+
+directive CONFLICTS > "${RUN_DIR}/mapped_conflicts.out"
+directive THREADS > "${RUN_DIR}/mapped_threads.out"
+directive GLOBALS > "${RUN_DIR}/fs_globals.txt"
+directive TRACE > "${RUN_DIR}/pinatrace.out"
+read -r -a FIX_ARGS <<< "$(directive FIX-ARGS)"
+
+# The pass reads the text profile from the working directory
+cd "${RUN_DIR}"
+if [ -s pinatrace.out ]; then
+    "${ANALYZE}" pinatrace.out /dev/null fs_globals.txt 64 > /dev/null
+    FIX_ARGS+=(-fs-profile=mapped_profile.fsp)
+fi
+"${OPT}" -enable-new-pm=0 -load "${PLUGIN}" -false-sharing-fix "${FIX_ARGS[@]}" \
+    -S "${TEST}" -o - 2>&1 | "${FILECHECK}" "${TEST}"
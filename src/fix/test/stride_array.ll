@@ -0,0 +1,31 @@
+; An array whose elements conflicted with each other is strided, so that
+; each element gets its own cache line, and its element GEPs step over the
+; padding. An externally visible array is only strided with
+; -fs-whole-program, which is off here.
+;
+; CONFLICTS: counts 0 8 counts 8 8 1000
+; CONFLICTS: shared 0 8 shared 8 8 1000
+
+; CHECK-DAG: Striding array counts: 8 -> 64 bytes per element
+; CHECK-DAG: Unable to stride array shared - externally visible
+; CHECK: @counts = internal global [4 x { i64, [56 x i8] }] zeroinitializer, align 64
+; CHECK: @shared = global [4 x i64] zeroinitializer
+; CHECK-LABEL: define void @count
+; CHECK: %element = getelementptr inbounds [4 x { i64, [56 x i8] }], [4 x { i64, [56 x i8] }]* @counts, i64 0, i64 %thread, i32 0
+; CHECK: store i64 1, i64* %element
+; CHECK: store i64 2, i64* getelementptr inbounds ([4 x { i64, [56 x i8] }], [4 x { i64, [56 x i8] }]* @counts, i64 0, i64 1, i32 0)
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+@counts = internal global [4 x i64] zeroinitializer
+@shared = global [4 x i64] zeroinitializer
+
+define void @count(i64 %thread) {
+  %element = getelementptr inbounds [4 x i64], [4 x i64]* @counts, i64 0, i64 %thread
+  store i64 1, i64* %element
+  store i64 2, i64* getelementptr inbounds ([4 x i64], [4 x i64]* @counts, i64 0, i64 1)
+  %other = getelementptr inbounds [4 x i64], [4 x i64]* @shared, i64 0, i64 %thread
+  store i64 3, i64* %other
+  ret void
+}
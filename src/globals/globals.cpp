@@ -12,6 +12,11 @@
 
 using namespace llvm;
 
+// Addresses in the main executable are printed as offsets from its start,
+// tagged with module 1 in the top 16 bits, to match the normalized addresses
+// written by the Pin tools (see pin/modules.PH).
+static const uint64_t mainModuleTag = uint64_t(1) << 48;
+
 namespace {
 
 struct Globals583 : public ModulePass {
@@ -67,18 +72,41 @@ struct Globals583 : public ModulePass {
       }
     }
 
+    // The linker defines these at the start and end of the executable image.
+    // If it does not, both are null and addresses are printed unchanged.
+    auto getImageBound = [&](StringRef name) {
+      auto *bound = M.getOrInsertGlobal(name, builder.getInt8Ty());
+      if (auto *boundVar = dyn_cast<GlobalVariable>(bound)) {
+        if (boundVar->isDeclaration()) {
+          boundVar->setLinkage(GlobalValue::ExternalWeakLinkage);
+          boundVar->setVisibility(GlobalValue::HiddenVisibility);
+        }
+      }
+      return builder.CreatePtrToInt(bound, builder.getInt64Ty());
+    };
+    auto *imageStart = getImageBound("__ehdr_start");
+    auto *imageEnd = getImageBound("_end");
+
     for (auto *global : globals) {
-      // fprintf("%s\t%p\t%lld\n", name, address, size);
+      // fprintf("%s\t0x%llx\t%lld\n", name, normalized address, size);
       auto *name = builder.CreateGlobalStringPtr(global->getName());
       auto *size = ConstantInt::get(
         builder.getInt64Ty(),
         dataLayout.getTypeSizeInBits(global->getValueType()).getFixedSize() / 8
       );
+      auto *address = builder.CreatePtrToInt(global, builder.getInt64Ty());
+      auto *inImage = builder.CreateAnd(builder.CreateICmpUGE(address, imageStart),
+                                        builder.CreateICmpULT(address, imageEnd));
+      auto *normalized = builder.CreateSelect(
+        inImage,
+        builder.CreateOr(builder.CreateSub(address, imageStart), mainModuleTag),
+        address
+      );
       builder.CreateCall(fprintfFunc, SmallVector<Value *>{
         fileHandle,
-        builder.CreateGlobalStringPtr("%s\t%p\t%lld\n"),
+        builder.CreateGlobalStringPtr("%s\t0x%llx\t%lld\n"),
         name,
-        global,
+        normalized,
         size
       });
     }
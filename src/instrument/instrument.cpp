@@ -0,0 +1,252 @@
+//// LLVM pass to instrument memory accesses for online false sharing detection ////
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/CaptureTracking.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Pass.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+
+using namespace llvm;
+
+// Whether to instrument accesses that may not be to globals, e.g. to the heap.
+// Accesses to stack and heap objects that never escape are not instrumented.
+static cl::opt<bool> instrumentHeap(
+  "fs-instrument-heap",
+  cl::desc("Instrument accesses to the heap as well as to globals"),
+  cl::init(false));
+
+// Whether to merge reads, and writes, of overlapping or adjacent bytes on the
+// same cache line within a basic block into a single event.
+static cl::opt<bool> coalesceAccesses(
+  "fs-coalesce-accesses",
+  cl::desc("Record accesses to the same cache line in a basic block once"),
+  cl::init(true));
+
+// This must be a power of 2 and match the runtime's cache line size.
+static const uint64_t cacheLineSize = 64; // in bytes
+
+namespace {
+
+// A memory access made by an instruction
+struct MemoryAccess {
+  Value *pointer;
+  Value *size; // in bytes
+  bool isWrite;
+};
+
+// Returns the memory accesses made by an instruction, if any.
+static SmallVector<MemoryAccess, 2> getAccesses(const DataLayout &dataLayout,
+                                                Instruction *inst) {
+  auto *int64Ty = Type::getInt64Ty(inst->getContext());
+  auto sizeOf = [&](Type *type) {
+    return ConstantInt::get(int64Ty, dataLayout.getTypeStoreSize(type));
+  };
+
+  SmallVector<MemoryAccess, 2> accesses;
+  if (auto *load = dyn_cast<LoadInst>(inst)) {
+    accesses.push_back({load->getPointerOperand(), sizeOf(load->getType()), false});
+  } else if (auto *store = dyn_cast<StoreInst>(inst)) {
+    accesses.push_back({store->getPointerOperand(),
+                        sizeOf(store->getValueOperand()->getType()), true});
+  } else if (auto *rmw = dyn_cast<AtomicRMWInst>(inst)) {
+    accesses.push_back({rmw->getPointerOperand(),
+                        sizeOf(rmw->getValOperand()->getType()), true});
+  } else if (auto *cmpxchg = dyn_cast<AtomicCmpXchgInst>(inst)) {
+    accesses.push_back({cmpxchg->getPointerOperand(),
+                        sizeOf(cmpxchg->getNewValOperand()->getType()), true});
+  } else if (auto *memIntrinsic = dyn_cast<MemIntrinsic>(inst)) {
+    accesses.push_back({memIntrinsic->getRawDest(), memIntrinsic->getLength(), true});
+    if (auto *memTransfer = dyn_cast<MemTransferInst>(memIntrinsic)) {
+      accesses.push_back({memTransfer->getRawSource(), memTransfer->getLength(), false});
+    }
+  }
+  return accesses;
+}
+
+// Decides which accesses may touch memory shared between threads. Only
+// non-constant, non-thread-local globals are considered shared, plus, with
+// -fs-instrument-heap, any other object that may escape its allocating thread.
+class SharedMemoryFilter {
+public:
+  bool mayBeShared(const Value *pointer) {
+    SmallVector<const Value *, 4> objects;
+    getUnderlyingObjects(pointer, objects);
+    return std::any_of(objects.begin(), objects.end(), [&](const Value *object) {
+      return objectMayBeShared(object);
+    });
+  }
+
+private:
+  DenseMap<const Value *, bool> escapes;
+
+  bool objectMayBeShared(const Value *object) {
+    if (auto *globalVar = dyn_cast<GlobalVariable>(object)) {
+      return !globalVar->isThreadLocal() && !globalVar->isConstant() &&
+             !globalVar->getName().startswith("llvm.");
+    }
+    if (!instrumentHeap) {
+      return false;
+    }
+    // Stack and heap objects allocated here are private to this thread unless
+    // their address escapes.
+    if (isa<AllocaInst>(object) || isNoAliasCall(object)) {
+      auto it = escapes.find(object);
+      if (it == escapes.end()) {
+        it = escapes.try_emplace(object, PointerMayBeCaptured(object, true, true)).first;
+      }
+      return it->second;
+    }
+    return true;
+  }
+};
+
+// An access to be recorded at runtime, possibly covering several accesses in
+// the same basic block
+struct Event {
+  Instruction *insertPoint;
+  MemoryAccess access;
+  const Value *base;   // null if the access has no constant offset or size
+  int64_t begin, end;  // byte range relative to base
+  bool merged;
+};
+
+// Tries to merge an access at [begin, end) from the event's base into the
+// event. Only accesses of the same kind whose ranges overlap or touch are
+// merged, so that the event covers no bytes that were not accessed, and only
+// if one contains the other or the combined range is known to lie within a
+// single cache line. Otherwise the detector would see true sharing on bytes
+// that were only falsely shared.
+static bool tryMerge(const DataLayout &dataLayout, Event &event,
+                     int64_t begin, int64_t end, bool isWrite) {
+  if (event.access.isWrite != isWrite || begin > event.end || end < event.begin) {
+    return false;
+  }
+  int64_t newBegin = std::min(event.begin, begin);
+  int64_t newEnd = std::max(event.end, end);
+  bool contained = (newBegin == event.begin && newEnd == event.end) ||
+                   (newBegin == begin && newEnd == end);
+  if (!contained) {
+    // The base's alignment (up to a cache line) bounds where line boundaries
+    // can fall relative to it.
+    uint64_t unit = std::min<uint64_t>(
+      event.base->getPointerAlignment(dataLayout).value(), cacheLineSize);
+    if (alignDown(newBegin, unit) != alignDown(newEnd - 1, unit)) {
+      return false;
+    }
+  }
+  event.begin = newBegin;
+  event.end = newEnd;
+  event.merged = true;
+  return true;
+}
+
+struct Instrument583 : public ModulePass {
+  static char ID;
+  Instrument583() : ModulePass(ID) {}
+
+  bool runOnModule(Module &M) override {
+    auto &context = M.getContext();
+    auto &dataLayout = M.getDataLayout();
+    IRBuilder<> builder(context);
+
+    // void __fs583_record(i8 *addr, i64 size, i32 isWrite)
+    auto *recordType = FunctionType::get(
+      builder.getVoidTy(),
+      SmallVector<Type *>{builder.getInt8PtrTy(), builder.getInt64Ty(), builder.getInt32Ty()},
+      false
+    );
+    auto recordFunc = M.getOrInsertFunction("__fs583_record", recordType);
+
+    SharedMemoryFilter filter;
+    uint64_t numAccesses = 0;
+    uint64_t numInstrumented = 0;
+    uint64_t numEvents = 0;
+
+    bool changed = false;
+    for (auto &F : M) {
+      if (F.isDeclaration()) {
+        continue;
+      }
+
+      // Collect the events first, since instrumenting adds instructions.
+      SmallVector<Event> events;
+      for (auto &BB : F) {
+        // base -> indices of this block's events with that base
+        DenseMap<const Value *, SmallVector<size_t, 2>> eventsByBase;
+        for (auto &I : BB) {
+          for (auto &access : getAccesses(dataLayout, &I)) {
+            ++numAccesses;
+            if (!filter.mayBeShared(access.pointer)) {
+              continue;
+            }
+            ++numInstrumented;
+
+            Event event{&I, access, nullptr, 0, 0, false};
+            auto *size = dyn_cast<ConstantInt>(access.size);
+            if (coalesceAccesses && size) {
+              event.base = GetPointerBaseWithConstantOffset(access.pointer, event.begin, dataLayout);
+              event.end = event.begin + size->getSExtValue();
+              auto &candidates = eventsByBase[event.base];
+              bool merged = std::any_of(candidates.begin(), candidates.end(), [&](size_t i) {
+                return tryMerge(dataLayout, events[i], event.begin, event.end, access.isWrite);
+              });
+              if (merged) {
+                continue;
+              }
+              candidates.push_back(events.size());
+            }
+            events.push_back(event);
+          }
+        }
+      }
+
+      for (auto &event : events) {
+        auto &access = event.access;
+        builder.SetInsertPoint(event.insertPoint);
+        Value *pointer = nullptr;
+        Value *size = nullptr;
+        if (event.merged) {
+          // The base dominates the first access it was found through.
+          pointer = builder.CreateConstGEP1_64(
+            builder.getInt8Ty(),
+            builder.CreatePointerBitCastOrAddrSpaceCast(const_cast<Value *>(event.base), builder.getInt8PtrTy()),
+            event.begin
+          );
+          size = builder.getInt64(event.end - event.begin);
+        } else {
+          pointer = builder.CreatePointerBitCastOrAddrSpaceCast(access.pointer, builder.getInt8PtrTy());
+          size = builder.CreateZExtOrTrunc(access.size, builder.getInt64Ty());
+        }
+        builder.CreateCall(recordFunc, SmallVector<Value *>{
+          pointer,
+          size,
+          builder.getInt32(access.isWrite)
+        });
+        ++numEvents;
+        changed = true;
+      }
+    }
+
+    errs() << "Instrumented " << numInstrumented << " of " << numAccesses
+           << " memory accesses with " << numEvents << " events\n";
+    return changed;
+  }
+}; // end of struct Instrument583
+
+}  // end of anonymous namespace
+
+char Instrument583::ID = 0;
+static RegisterPass<Instrument583> X("false-sharing-instrument",
+                                     "Pass to instrument memory accesses for false sharing detection",
+                                     false /* Only looks at CFG */,
+                                     false /* Analysis Pass */);
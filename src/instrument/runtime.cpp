@@ -0,0 +1,113 @@
+//// Runtime for binaries instrumented by the false-sharing-instrument pass ////
+// Accesses are buffered per thread and fed into an InterferenceDetector shared
+// by all threads whenever a buffer fills up or its thread exits. At program
+// exit, the interferences are written in the same format as detect's output:
+//   fs_instrument.out.cacheline64.interferences
+//   fs_instrument.out.cacheline64.threads
+// Addresses in the executable are normalized like those of the Pin tools (see
+// pin/modules.PH), to match fs_globals.txt.
+
+#include "../../pin/detect/InterferenceDetector.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Defined by the linker at the start and end of the executable image
+extern "C" char __ehdr_start __attribute__((weak, visibility("hidden")));
+extern "C" char _end __attribute__((weak, visibility("hidden")));
+
+namespace {
+
+constexpr uint64_t cacheline_size = 64;
+constexpr uint64_t main_module_tag = uint64_t(1) << 48;
+constexpr size_t buffer_capacity = 4096;
+const std::string output_prefix =
+    "fs_instrument.out.cacheline" + std::to_string(cacheline_size);
+
+struct SharedDetector {
+  std::mutex mu;
+  InterferenceDetector detector{cacheline_size};
+};
+
+void output_interferences();
+
+// Never destroyed, so threads that outlive main can still flush into it.
+SharedDetector &shared_detector() {
+  static SharedDetector *shared = [] {
+    auto *shared = new SharedDetector;
+    std::atexit(output_interferences);
+    return shared;
+  }();
+  return *shared;
+}
+
+void output_interferences() {
+  auto &shared = shared_detector();
+  std::lock_guard<std::mutex> lock(shared.mu);
+
+  std::ofstream interferences_out(output_prefix + ".interferences");
+  shared.detector.outputInterferences(interferences_out);
+  std::ofstream threads_out(output_prefix + ".threads");
+  shared.detector.outputThreadAccesses(threads_out);
+}
+
+// Register the output handler at startup rather than on the first flush,
+// which may only happen while the program is already exiting.
+const bool initialized = (shared_detector(), true);
+
+uint64_t normalize_address(uint64_t addr) {
+  const auto start = reinterpret_cast<uint64_t>(&__ehdr_start);
+  const auto end = reinterpret_cast<uint64_t>(&_end);
+  if (addr >= start && addr < end) {
+    return main_module_tag | (addr - start);
+  }
+  return addr;
+}
+
+std::atomic<uint64_t> next_thread_id{0};
+
+struct ThreadBuffer {
+  struct Record {
+    uint64_t addr;
+    uint64_t size;
+    bool isWrite;
+  };
+
+  uint64_t thread_id = next_thread_id++;
+  std::vector<Record> records;
+
+  ThreadBuffer() { records.reserve(buffer_capacity); }
+  ~ThreadBuffer() { flush(); }
+
+  void flush() {
+    auto &shared = shared_detector();
+    std::lock_guard<std::mutex> lock(shared.mu);
+    for (const auto &record : records) {
+      shared.detector.recordAccess(record.isWrite,
+                                   normalize_address(record.addr), record.size,
+                                   thread_id);
+    }
+    records.clear();
+  }
+};
+
+thread_local ThreadBuffer buffer;
+
+} // namespace
+
+extern "C" void __fs583_record(void *addr, uint64_t size, uint32_t isWrite) {
+  if (size == 0) {
+    return;
+  }
+  buffer.records.push_back(
+      {reinterpret_cast<uint64_t>(addr), size, isWrite != 0});
+  if (buffer.records.size() >= buffer_capacity) {
+    buffer.flush();
+  }
+}
@@ -5,7 +5,7 @@ set -Eeuo pipefail
 # set -x
 
 usage() {
-    >&2 echo "Usage: ./run.sh <path to benchmark, without the file extension .cpp> [globals|fix]"
+    >&2 echo "Usage: ./run.sh <path to benchmark, without the file extension .cpp> [globals|fix|instrument]"
     exit 1
 }
 
@@ -24,12 +24,30 @@ NAME="$(basename "${1}")"
  # Specify your build directory in the project
 PATH2GLOBALS=${SRC_DIR}/build/globals/LLVMGLOBALS.so
 PATH2FIX=${SRC_DIR}/build/fix/LLVMFALSEFIX.so
+PATH2INSTRUMENT=${SRC_DIR}/build/instrument/LLVMINSTRUMENT.so
+PATH2RUNTIME=${SRC_DIR}/build/instrument/libFS583Runtime.a
 PASSGLOBALS=-false-sharing-globals
 PASSFIX=-false-sharing-fix   
+PASSINSTRUMENT=-false-sharing-instrument
 
+# Extra options for the fix pass can be set in the environment, e.g.
+# FIXFLAGS=-fs-whole-program to also rewrite externally visible globals
+read -r -a FIXFLAGS <<< "${FIXFLAGS:-}"
+# Prefer the binary profile written by analyze/MapAddr over mapped_conflicts.out
+if [ -f mapped_profile.fsp ]; then
+    FIXFLAGS+=(-fs-profile=mapped_profile.fsp)
+fi
+
+# The instrumented binary detects interferences itself, but still needs the
+# globals pass to output fs_globals.txt for MapAddr
+INSTRUMENTFLAGS=(-load "${PATH2GLOBALS}" "${PASSGLOBALS}")
+
+PASSFLAGS=()
+LINKFLAGS=()
 case "${PASS}" in
-    globals) PASSARG="${PASSGLOBALS}"; PASSPATH="${PATH2GLOBALS}";;
-    fix)     PASSARG="${PASSFIX}";     PASSPATH="${PATH2FIX}";;
+    globals)    PASSARG="${PASSGLOBALS}";    PASSPATH="${PATH2GLOBALS}";;
+    fix)        PASSARG="${PASSFIX}";        PASSPATH="${PATH2FIX}"; PASSFLAGS=("${FIXFLAGS[@]}");;
+    instrument) PASSARG="${PASSINSTRUMENT}"; PASSPATH="${PATH2INSTRUMENT}"; PASSFLAGS=("${INSTRUMENTFLAGS[@]}"); LINKFLAGS=("${PATH2RUNTIME}");;
     *) usage
 esac
 
@@ -43,10 +61,10 @@ echo 'Compiling benchmark to bitcode...'
 clang -O3 -emit-llvm -I/usr/include/llvm-c-10 -I/usr/include/llvm-10 "${BENCH}" -c -o "${RUN_DIR}/${NAME}.bc"
 
 echo 'Running pass...'
-opt -load "${PASSPATH}" "${PASSARG}" "${RUN_DIR}/${NAME}.bc" -o "${RUN_DIR}/${NAME}.${PASS}.bc"
+opt -load "${PASSPATH}" "${PASSARG}" "${PASSFLAGS[@]}" "${RUN_DIR}/${NAME}.bc" -o "${RUN_DIR}/${NAME}.${PASS}.bc"
 
 echo 'Generating final executable...'
-clang -O3 -pthread -lstdc++ "${RUN_DIR}/${NAME}.${PASS}.bc" -o "${RUN_DIR}/${NAME}_${PASS}"
+clang -O3 -pthread -lstdc++ "${RUN_DIR}/${NAME}.${PASS}.bc" "${LINKFLAGS[@]}" -o "${RUN_DIR}/${NAME}_${PASS}"
 
 echo 'Running final executable...'
 "${RUN_DIR}/${NAME}_${PASS}" || true # Ignore return code of actual executable